@@ -0,0 +1,176 @@
+// *********************************************************************
+// **
+// ** File: benchmark.cpp
+// ** Scaling benchmark (synthetic figures)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <sys/resource.h>
+#include "benchmark.hpp"
+#include "figures.hpp"
+#include "svg_size.hpp"
+
+// *****************************************************************************
+// Aux functions
+
+// value (in kB) of a field in /proc/self/status, 0 when not available
+
+static std::size_t proc_status_kb( const std::string & field )
+{
+   std::ifstream status( "/proc/self/status" );
+   std::string line ;
+   while( std::getline( status, line ) )
+      if ( line.compare( 0, field.size()+1, field + ":" ) == 0 )
+         return std::size_t( std::stoul( line.substr( field.size()+1 ) ) );
+   return 0 ;
+}
+// -----------------------------------------------------------------------------
+// reset the peak RSS (VmHWM) to the current RSS (Linux only)
+
+static void reset_peak_rss()
+{
+   std::ofstream clear_refs( "/proc/self/clear_refs" );
+   if ( clear_refs )
+      clear_refs << "5" << std::flush ;
+}
+// -----------------------------------------------------------------------------
+
+static std::size_t peak_rss_kb()
+{
+   const std::size_t hwm = proc_status_kb( "VmHWM" );
+   if ( 0 < hwm )
+      return hwm ;
+
+   struct rusage usage ;   // (process peak, in kB on Linux)
+   getrusage( RUSAGE_SELF, &usage );
+   return std::size_t( usage.ru_maxrss );
+}
+// -----------------------------------------------------------------------------
+// run 'phase' and measure it, 'phase' returns the output bytes
+
+static BenchmarkPhase measure( std::size_t vertexes, const std::string & name,
+                               const std::function<std::size_t()> & phase )
+{
+   BenchmarkPhase m ;
+   m.vertexes = vertexes ;
+   m.name     = name ;
+
+   reset_peak_rss();
+   const auto start = std::chrono::steady_clock::now();
+   m.bytes   = phase();
+   m.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+   m.rss_kb      = proc_status_kb( "VmRSS" );
+   m.peak_rss_kb = peak_rss_kb();
+   return m ;
+}
+
+// *****************************************************************************
+// class BenchmarkPhase
+// -----------------------------------------------------------------------------
+
+BenchmarkPhase::BenchmarkPhase()
+{
+   vertexes    = 0 ;
+   seconds     = 0.0 ;
+   bytes       = 0 ;
+   rss_kb      = 0 ;
+   peak_rss_kb = 0 ;
+}
+
+// *****************************************************************************
+// class ScalingBenchmark
+// -----------------------------------------------------------------------------
+
+ScalingBenchmark::ScalingBenchmark()
+{
+   sizes    = defaultSizes( 10000000 );
+   width_px = 1024 ;
+}
+// -----------------------------------------------------------------------------
+
+std::vector<std::size_t> ScalingBenchmark::defaultSizes( std::size_t max_vertexes )
+{
+   std::vector<std::size_t> s ;
+   for( std::size_t decade = 1000 ; decade <= max_vertexes ; decade *= 10 )
+      for( std::size_t f : { 1, 2, 5 } )
+         if ( f*decade <= max_vertexes )
+            s.push_back( f*decade );
+   return s ;
+}
+// -----------------------------------------------------------------------------
+
+std::vector<BenchmarkPhase> ScalingBenchmark::run( std::ostream & report )
+{
+   using namespace std ;
+   std::vector<BenchmarkPhase> measures ;
+
+   report << "vertexes\tphase\tseconds\tbytes\trss_kb\tpeak_rss_kb" << endl ;
+
+   for( std::size_t size : sizes )
+   {
+      const SyntheticParams params = SyntheticParams::withVertexes( size );
+      const std::size_t     nv     = params.numVertexes() ;
+      FigureSynthetic *     fig    = nullptr ;
+
+      const std::size_t first = measures.size() ;
+
+      measures.push_back( measure( nv, "build", [&]()
+      {
+         fig = new FigureSynthetic( params );
+         return std::size_t( 0 );
+      }));
+      measures.push_back( measure( nv, "project", [&]()
+      {
+         vec2 box_min, box_w ;
+         fig->viewBox( box_min, box_w );
+         return std::size_t( 0 );
+      }));
+      measures.push_back( measure( nv, "svg", [&]()
+      {
+         CountingStreamBuf buf ; // (discards the output)
+         std::ostream      os( &buf );
+         fig->drawSVG( os );
+         return buf.count ;
+      }));
+      measures.push_back( measure( nv, "png", [&]()
+      {
+         return fig->drawBytes( "png", width_px ).size() ;
+      }));
+      measures.push_back( measure( nv, "pdf", [&]()
+      {
+         return fig->drawBytes( "pdf" ).size() ;
+      }));
+      measures.push_back( measure( nv, "destroy", [&]()
+      {
+         delete fig ;
+         fig = nullptr ;
+         return std::size_t( 0 );
+      }));
+
+      for( std::size_t i = first ; i < measures.size() ; i++ )
+      {
+         const BenchmarkPhase & m = measures[i] ;
+         report << m.vertexes << "\t" << m.name << "\t" << m.seconds << "\t" << m.bytes
+                << "\t" << m.rss_kb << "\t" << m.peak_rss_kb << endl ;
+      }
+   }
+   return measures ;
+}
@@ -0,0 +1,71 @@
+// *********************************************************************
+// **
+// ** File: benchmark.hpp
+// ** Declarations for the scaling benchmark (synthetic figures)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// *****************************************************************************
+// class BenchmarkPhase
+// measures of one phase of the benchmark, for one size
+
+class BenchmarkPhase
+{
+   public:
+   BenchmarkPhase();
+
+   std::size_t vertexes ;     // vertexes in the figure
+   std::string name ;         // 'build', 'project', 'svg', 'png', 'pdf' or 'destroy'
+   double      seconds ;      // wall time
+   std::size_t bytes ;        // output bytes (0 for phases without output)
+   std::size_t rss_kb ;       // resident set size at the end of the phase
+   std::size_t peak_rss_kb ;  // peak resident set size during the phase (see below)
+} ;
+
+// *****************************************************************************
+// class ScalingBenchmark
+// Builds a synthetic figure (FigureSynthetic) for each size, and measures the
+// phases: build, project, write the SVG (to a stream which just counts the
+// bytes), the PNG and the PDF (in memory), and destroy. On Linux, the peak RSS
+// is reset before each phase (through /proc/self/clear_refs), so it is the peak
+// of that phase; elsewhere, it is the peak of the process so far.
+
+class ScalingBenchmark
+{
+   public:
+   ScalingBenchmark();
+
+   // sizes from 1000 vertexes up to 'max_vertexes', three per decade (1, 2, 5)
+   static std::vector<std::size_t> defaultSizes( std::size_t max_vertexes );
+
+   // run all the sizes (smallest first), writing a line for each phase to 'report'
+   // (tab separated values, after a header line), returns all the measures
+   std::vector<BenchmarkPhase> run( std::ostream & report ) ;
+
+   std::vector<std::size_t> sizes ;  // number of vertexes of each figure
+   unsigned                 width_px ; // width of the PNG outputs
+} ;
+
+#endif
@@ -20,7 +20,11 @@
 //
 
 #include <cmath>
+#include <memory>
+#include <random>
+#include <stdexcept>
 #include "figures.hpp"
+#include "parallel.hpp"
 
 // *****************************************************************************
 
@@ -407,26 +411,74 @@ Point * pbt0 = new Point( vec3(-bt,0.0,1.0), colEllTan ),
 }
 
 // ***********************************************************************
+// parameters shared by all the PSA figures
 
-void FigurePSA_Base::initialize(  )
+static const vec3 psa_observ = vec3(1.2,0.6,1.0),
+                  psa_lookat = vec3(0.0,0.0,0.0),
+                  psa_vup    = vec3(0.0,1.0,0.0);
+
+// -----------------------------------------------------------------------------
+
+FigurePSA_Base::FigurePSA_Base()
+{
+   disk_radius     = 1.0 ;
+   draw_projectors = false ;
+   clip_neg        = false ;
+   original_pol    = nullptr ;
+}
+// -----------------------------------------------------------------------------
+
+FigurePSA_Base::~FigurePSA_Base()
+{
+   for( Object * pobj : created )
+      delete pobj ;
+   delete original_pol ;
+}
+// -----------------------------------------------------------------------------
+
+Camera FigurePSA_Base::camera()
+{
+   return Camera( psa_lookat, psa_observ, psa_vup );
+}
+// -----------------------------------------------------------------------------
+
+Object * FigurePSA_Base::newHemisphere( bool flip_axes )
+{
+   const vec3 org = vec3(0.0,0.0,0.0);
+   return new Hemisphere( org, 1.0, (psa_observ-psa_lookat).normalized(), flip_axes ) ;
+}
+// -----------------------------------------------------------------------------
+
+void FigurePSA_Base::createDisk()
 {
+   const vec3
+      disk_center_norm = disk_center.normalized(),
+      disk_axis_1      = disk_center.cross( {0.0,1.0,0.0} ).normalized(),
+      disk_axis_2      = disk_axis_1.cross( disk_center_norm  ).normalized() ;
 
-   const vec3 org    = vec3(0.0,0.0,0.0),
-              ejex   = vec3(1.0,0.0,0.0),
-              ejey   = vec3(0.0,1.0,0.0),
-              ejez   = vec3(0.0,0.0,1.0),
-              observ = vec3(1.2,0.6,1.0),
-              lookat = vec3(0.0,0.0,0.0),
-              vup    = vec3(0.0,1.0,0.0);
+   original_pol = new Ellipse( 256, disk_center, disk_radius*disk_axis_1,
+                                                 disk_radius*disk_axis_2 );
+}
+// -----------------------------------------------------------------------------
 
-   cam = Camera( lookat, observ, vup );
+void FigurePSA_Base::initialize( Object * shared_hemisphere )
+{
+   const Precision precision = cam.precision ; // (kept, as set by derived classes)
+   cam = camera();
+   cam.precision = precision ;
    using namespace std ;
-   cout << "FigurePSA_Base::initialize, flip_axes == " << flip_axes << endl ;
+   if ( shared_hemisphere == nullptr )
+      cout << "FigurePSA_Base::initialize, flip_axes == " << flip_axes << endl ;
 
    // create objects
    auto * sphere_cap    = new SpherePolygon( *original_pol, true );
    auto * hor_plane_pol = new HorPlanePolygon( *sphere_cap, true );
-   auto * hemisphere    = new Hemisphere( org, 1.0, (observ-lookat).normalized(), flip_axes ) ;
+   Object * hemisphere  = shared_hemisphere ;
+   if ( hemisphere == nullptr )
+   {
+      hemisphere = newHemisphere( flip_axes );
+      created.push_back( hemisphere );
+   }
 
    sphere_cap->style.use_grad_fill = true ;
    sphere_cap->style.fill_opacity = 0.5 ;
@@ -445,14 +497,18 @@ void FigurePSA_Base::initialize(  )
    {
       auto * projectors    = new ExtrVertSegm( *sphere_cap, *hor_plane_pol, cam );
       objetos.add( projectors );
+      created.push_back( projectors );
    }
 
    objetos.add( hemisphere );
    objetos.add( sphere_cap );
    objetos.add( hor_plane_pol );
 
-
+   created.push_back( sphere_cap );
+   created.push_back( hor_plane_pol );
+   created.push_back( dashed_ellipse );
 }
+
 // ***********************************************************************
 
 
@@ -466,13 +522,7 @@ Figure7_PSA_shape::Figure7_PSA_shape()
    flip_axes = true ;
 
    // create original disk
-   const vec3
-      disk_center_norm = disk_center.normalized(),
-      disk_axis_1      = disk_center.cross( {0.0,1.0,0.0} ).normalized(),
-      disk_axis_2      = disk_axis_1.cross( disk_center_norm  ).normalized() ;
-
-   original_pol = new Ellipse( 256, disk_center, disk_radius*disk_axis_1,
-                                                 disk_radius*disk_axis_2 );
+   createDisk();
 
    // initilize base class
    initialize();
@@ -491,13 +541,7 @@ Figure8_PSA_ellipse::Figure8_PSA_ellipse()
    flip_axes = true ;
 
    // create original disk
-   const vec3
-      disk_center_norm = disk_center.normalized(),
-      disk_axis_1      = disk_center.cross( {0.0,1.0,0.0} ).normalized(),
-      disk_axis_2      = disk_axis_1.cross( disk_center_norm  ).normalized() ;
-
-   original_pol = new Ellipse( 256, disk_center, disk_radius*disk_axis_1,
-                                                 disk_radius*disk_axis_2 );
+   createDisk();
 
    // initilize base class
    initialize();
@@ -516,13 +560,7 @@ Figure9_PSA_ellipse_lune::Figure9_PSA_ellipse_lune()
    flip_axes = true ;
 
    // create original disk
-   const vec3
-      disk_center_norm = disk_center.normalized(),
-      disk_axis_1      = disk_center.cross( {0.0,1.0,0.0} ).normalized(),
-      disk_axis_2      = disk_axis_1.cross( disk_center_norm  ).normalized() ;
-
-   original_pol = new Ellipse( 256, disk_center, disk_radius*disk_axis_1,
-                                                 disk_radius*disk_axis_2 );
+   createDisk();
 
    // initilize base class
    initialize();
@@ -540,14 +578,227 @@ Figure10_PSA_lune::Figure10_PSA_lune()
    draw_projectors = false ;
 
    // create original disk
-   const vec3
-      disk_center_norm = disk_center.normalized(),
-      disk_axis_1      = disk_center.cross( {0.0,1.0,0.0} ).normalized(),
-      disk_axis_2      = disk_axis_1.cross( disk_center_norm  ).normalized() ;
-
-   original_pol = new Ellipse( 256, disk_center, disk_radius*disk_axis_1,
-                                                 disk_radius*disk_axis_2 );
+   createDisk();
 
    // initilize base class
    initialize();
 }
+
+// ***********************************************************************
+
+PSAParams::PSAParams()
+{
+   disk_center     = vec3( 3.0, 3.0, 0.0 );
+   disk_radius     = 2.2 ;
+   draw_projectors = true ;
+   flip_axes       = true ;
+   precision       = Precision::Single ;
+}
+// -----------------------------------------------------------------------------
+
+FigurePSA_Params::FigurePSA_Params( const PSAParams & params, Object * shared_hemisphere )
+{
+   disk_center     = params.disk_center ;
+   disk_radius     = params.disk_radius ;
+   draw_projectors = params.draw_projectors ;
+   flip_axes       = params.flip_axes ;
+   cam.precision   = params.precision ;
+
+   createDisk();
+   initialize( shared_hemisphere );
+}
+
+// ***********************************************************************
+
+PSASweep::PSASweep()
+{
+   // by default, the parameters of figures 7 to 10
+   disk_centers    = { vec3( 3.0, 3.0, 0.0 ), vec3( 3.0, 3.5, 0.0 ), vec3( 3.0, 1.0, 0.0 ), vec3( 3.0, -1.0, 0.0 ) };
+   disk_radii      = { 2.2, 3.0, 5.0 };
+   draw_projectors = { true, false };
+   flip_axes       = { true, false };
+   precision       = Precision::Single ;
+}
+// -----------------------------------------------------------------------------
+
+std::vector<PSAParams> PSASweep::jobs() const
+{
+   std::vector<PSAParams> res ;
+   PSAParams p ;
+   for( const vec3 & center : disk_centers )
+   for( float radius : disk_radii )
+   for( bool projectors : draw_projectors )
+   for( bool flip : flip_axes )
+   {
+      p.disk_center     = center ;
+      p.disk_radius     = radius ;
+      p.draw_projectors = projectors ;
+      p.flip_axes       = flip ;
+      p.precision       = precision ;
+      res.push_back( p );
+   }
+   return res ;
+}
+// -----------------------------------------------------------------------------
+
+std::size_t PSASweep::run( const std::string & name_pattern, unsigned width_px )
+{
+   const std::vector<PSAParams> todo = jobs() ;
+   const std::size_t pos = name_pattern.find( '%' );
+   if ( pos == std::string::npos )
+      throw std::runtime_error( "the sweep file name pattern must contain a '%' ('" + name_pattern + "')" );
+
+   // invariant parts, built once: a hemisphere for each 'flip_axes' value
+   Camera cam = FigurePSA_Base::camera() ;
+   cam.precision = precision ;
+   std::unique_ptr<Object>            hemispheres[2] ;
+   std::unique_ptr<PrerenderedObject> shared[2] ;
+   for( bool flip : flip_axes )
+      if ( shared[flip] == nullptr )
+      {
+         hemispheres[flip].reset( FigurePSA_Base::newHemisphere( flip ) );
+         shared[flip].reset( new PrerenderedObject( hemispheres[flip].get(), cam ) );
+      }
+
+   // one job per file, in parallel
+   parallel_for_chunks( todo.size(), 1, [&]( std::size_t, std::size_t begin, std::size_t end )
+   {
+      for( std::size_t i = begin ; i < end ; i++ )
+      {
+         std::string nombre_arch = name_pattern ;
+         nombre_arch.replace( pos, 1, std::to_string( i ) );
+
+         FigurePSA_Params fig( todo[i], shared[todo[i].flip_axes].get() );
+         fig.draw( { nombre_arch }, width_px );
+      }
+   });
+   return todo.size() ;
+}
+
+// ***********************************************************************
+// class SyntheticParams
+// -----------------------------------------------------------------------------
+
+SyntheticParams::SyntheticParams()
+{
+   num_ellipses          = 1 ;
+   num_sphere_polygons   = 1 ;
+   num_cylinder_polygons = 1 ;
+   num_segments          = 1 ;
+   num_points            = 1 ;
+   polygon_vertexes      = 256 ;
+   seed                  = 1 ;
+}
+// -----------------------------------------------------------------------------
+
+SyntheticParams SyntheticParams::withVertexes( std::size_t num_vertexes )
+{
+   SyntheticParams p ;
+   const std::size_t nv = p.polygon_vertexes ;
+
+   p.num_ellipses          = std::max( std::size_t(1), num_vertexes/(4*nv) );
+   p.num_sphere_polygons   = std::max( std::size_t(1), num_vertexes/(8*nv) );
+   p.num_cylinder_polygons = p.num_sphere_polygons ;
+   p.num_segments          = std::max( std::size_t(1), num_vertexes/16 );
+   p.num_points            = std::max( std::size_t(1), num_vertexes/4 );
+   return p ;
+}
+// -----------------------------------------------------------------------------
+
+std::size_t SyntheticParams::numVertexes() const
+{
+   return (num_ellipses+num_sphere_polygons+num_cylinder_polygons)*polygon_vertexes
+          + 2*num_segments + num_points ;
+}
+
+// ***********************************************************************
+// class FigureSynthetic
+// -----------------------------------------------------------------------------
+
+FigureSynthetic::FigureSynthetic( const SyntheticParams & params )
+{
+   cam = Camera( vec3(0.0,0.0,0.0), vec3(0.4,0.5,1.0), vec3(0.0,1.0,0.0) );
+
+   std::mt19937 gen( params.seed );
+   std::uniform_real_distribution<real> unif( -1.0, 1.0 );
+   auto random_vec = [&]() { return vec3( unif(gen), unif(gen), unif(gen) ); };
+
+   // a random ellipse, out of the unit sphere and away from the Y axis (so it
+   // can be mapped onto the sphere and the cylinder)
+   auto random_ellipse = [&]()
+   {
+      const real ang    = real(M_PI)*unif(gen) ;
+      const vec3 center = vec3( real(1.5)*std::cos(ang), unif(gen), real(1.5)*std::sin(ang) );
+      return new Ellipse( params.polygon_vertexes, center, real(0.2)*random_vec(), real(0.2)*random_vec() );
+   };
+
+   for( std::size_t i = 0 ; i < params.num_ellipses ; i++ )
+   {
+      Ellipse * pe = random_ellipse();
+      pe->style.lines_width = 0.002 ;
+      created.push_back( pe );
+   }
+   for( std::size_t i = 0 ; i < params.num_sphere_polygons + params.num_cylinder_polygons ; i++ )
+   {
+      Polygon * orig = random_ellipse();
+      originals.push_back( orig );
+
+      Polygon * pmapped ;
+      if ( i < params.num_sphere_polygons )
+         pmapped = new SpherePolygon( *orig );
+      else
+         pmapped = new YCylinderPolygon( *orig );
+      pmapped->style.lines_width = 0.002 ;
+      created.push_back( pmapped );
+   }
+
+   SegmentBatch * segments = new SegmentBatch();
+   const unsigned istyle = segments->addStyle( vec3( 0.0, 0.7, 1.0 ), 0.001 );
+   segments->ends3D.reserve( 2*params.num_segments );
+   for( std::size_t i = 0 ; i < params.num_segments ; i++ )
+   {
+      const vec3 p0 = random_vec() ;
+      segments->add( p0, p0 + real(0.05)*random_vec(), istyle );
+   }
+   created.push_back( segments );
+
+   PointCloud * points = new PointCloud();
+   points->reserve( params.num_points );
+   for( std::size_t i = 0 ; i < params.num_points ; i++ )
+      points->add( random_vec(), i % 2 == 0 ? vec3( 1.0, 0.0, 0.0 ) : vec3( 0.0, 0.0, 1.0 ), 0.003 );
+   created.push_back( points );
+
+   for( Object * pobj : created )
+      objetos.add( pobj );
+}
+// -----------------------------------------------------------------------------
+
+FigureSynthetic::~FigureSynthetic()
+{
+   // in reverse order: each object removes itself from 'objetos' (see
+   // ObjectsSet), and removing the last one does not move the others
+   for( std::size_t i = created.size() ; 0 < i ; i-- )
+      delete created[i-1] ;
+   for( Polygon * orig : originals )
+      delete orig ;
+}
+
+// ***********************************************************************
+
+Figure * new_figure( int num )
+{
+   switch( num )
+   {
+      case 1  : return new Figure1_HatBox() ;
+      case 2  : return new Figure2_ParamCil() ;
+      case 3  : return new Figure3_ParamConPol() ;
+      case 4  : return new Figure4_EllipseSectorZ() ;
+      case 5  : return new Figure5_EllipseSectorRadial() ;
+      case 6  : return new Figure6_SuplPara() ;
+      case 7  : return new Figure7_PSA_shape() ;
+      case 8  : return new Figure8_PSA_ellipse() ;
+      case 9  : return new Figure9_PSA_ellipse_lune() ;
+      case 10 : return new Figure10_PSA_lune() ;
+      default : return nullptr ;
+   }
+}
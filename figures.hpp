@@ -74,14 +74,78 @@ class Figure6_SuplPara : public Figure
 class FigurePSA_Base : public Figure
 {
   public:
-  FigurePSA_Base() {}
-  void initialize();
+  FigurePSA_Base() ;
+  virtual ~FigurePSA_Base() ; // deletes the objects created by 'initialize'
+
+  // create 'original_pol' from 'disk_center' and 'disk_radius'
+  void createDisk();
+
+  // create the objects from the parameters and 'original_pol'. When 'shared_hemisphere'
+  // is not null, it is used instead of a new hemisphere (it must have been built
+  // by 'newHemisphere' with the same 'flip_axes', and projected with 'camera()')
+  void initialize( Object * shared_hemisphere = nullptr );
+
+  static Camera   camera();                        // camera of all PSA figures
+  static Object * newHemisphere( bool flip_axes ); // hemisphere of PSA figures
 
   vec3  disk_center ;
   float disk_radius  ;
   bool  draw_projectors ;
   bool  clip_neg ;
   Polygon * original_pol ;
+
+  std::vector<Object *> created ; // objects created by 'initialize' (owned)
+};
+
+// -----------------------------------------------------------------------------
+// parameters of a PSA figure
+
+class PSAParams
+{
+  public:
+  PSAParams();
+
+  vec3  disk_center ;
+  float disk_radius ;
+  bool  draw_projectors ;
+  bool  flip_axes ;
+  Precision precision ; // camera precision (Single by default)
+};
+
+// -----------------------------------------------------------------------------
+// a PSA figure with any parameters
+
+class FigurePSA_Params : public FigurePSA_Base
+{
+  public:
+  FigurePSA_Params( const PSAParams & params, Object * shared_hemisphere = nullptr );
+};
+
+// -----------------------------------------------------------------------------
+// class PSASweep
+// Renders a PSA figure for every combination of the values in the parameter
+// grids. The invariant parts (camera and hemisphere, one for each 'flip_axes'
+// value) are built, projected and formatted once, and shared by all the jobs;
+// only the disk and the objects derived from it are built for each job. Jobs
+// run in parallel.
+
+class PSASweep
+{
+  public:
+  PSASweep();
+
+  // all the combinations of the grid values (the last grid varies fastest)
+  std::vector<PSAParams> jobs() const ;
+
+  // render every job to a file whose name is 'name_pattern' with the first '%'
+  // replaced by the job index (e.g. "psa_%.png"), returns the number of jobs
+  std::size_t run( const std::string & name_pattern, unsigned width_px = 1024 ) ;
+
+  std::vector<vec3>  disk_centers ;
+  std::vector<float> disk_radii ;
+  std::vector<bool>  draw_projectors ;
+  std::vector<bool>  flip_axes ;
+  Precision          precision ; // camera precision for all the jobs (Single by default)
 };
 
 // -----------------------------------------------------------------------------
@@ -121,4 +185,50 @@ class Figure10_PSA_lune : public FigurePSA_Base
    Figure10_PSA_lune();
 } ;
 
+// -----------------------------------------------------------------------------
+// parameters of a synthetic figure (see FigureSynthetic)
+
+class SyntheticParams
+{
+  public:
+  SyntheticParams();
+
+  // about 'num_vertexes' vertexes: a quarter in ellipses, a quarter in mapped
+  // polygons (half on the sphere, half on the cylinder), an eighth in segments
+  // (two vertexes each) and the rest in points (at least one object of each kind)
+  static SyntheticParams withVertexes( std::size_t num_vertexes );
+
+  std::size_t numVertexes() const ; // total number of projected vertexes
+
+  std::size_t num_ellipses,           // planar ellipses (Ellipse)
+              num_sphere_polygons,    // ellipses mapped onto the sphere (SpherePolygon)
+              num_cylinder_polygons,  // ellipses mapped onto the cylinder (YCylinderPolygon)
+              num_segments,           // segments (in a single SegmentBatch)
+              num_points ;            // points (in a single PointCloud)
+  unsigned    polygon_vertexes ;      // vertexes of each ellipse (mapped or not)
+  unsigned    seed ;                  // seed for the random positions
+};
+
+// -----------------------------------------------------------------------------
+// class FigureSynthetic
+// A figure with random objects of each kind, as many as given in the
+// parameters, to measure how the code scales with the size of the figures
+// (see ScalingBenchmark)
+
+class FigureSynthetic : public Figure
+{
+  public:
+  FigureSynthetic( const SyntheticParams & params );
+  virtual ~FigureSynthetic() ; // deletes the objects created
+
+  std::vector<Object *>  created ;   // objects created (owned), in the order added
+  std::vector<Polygon *> originals ; // original polygons of mapped polygons (owned, not drawn)
+};
+
+// -----------------------------------------------------------------------------
+// create the figure with number 'num' (1 to 10), or return nullptr when there
+// is no such figure
+
+Figure * new_figure( int num ) ;
+
 #endif
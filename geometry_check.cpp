@@ -0,0 +1,151 @@
+// *********************************************************************
+// **
+// ** File: geometry_check.cpp
+// ** Validation of projected vertexes (NaN, infinite and repeated ones)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "geometry_check.hpp"
+
+// *****************************************************************************
+// class GeometryCheck
+// -----------------------------------------------------------------------------
+
+GeometryCheck::GeometryCheck()
+{
+   reset();
+}
+// -----------------------------------------------------------------------------
+
+void GeometryCheck::reset()
+{
+   checked  = 0 ;
+   nan      = 0 ;
+   inf      = 0 ;
+   repeated = 0 ;
+}
+// -----------------------------------------------------------------------------
+
+void GeometryCheck::report( std::ostream & os, const std::string & what ) const
+{
+   os << "WARNING: " << what << ": " << removed() << " of " << checked
+      << " projected vertexes removed (" << nan << " NaN, " << inf << " infinite, "
+      << repeated << " repeated)" << std::endl ;
+}
+
+// *****************************************************************************
+// Aux functions
+
+// a coordinate is finite when x-x is zero (it is NaN for NaN and infinite values)
+
+static inline bool finite2( const Vec2f & p )
+{
+   return p[0]-p[0] == 0.0f && p[1]-p[1] == 0.0f ;
+}
+// -----------------------------------------------------------------------------
+
+static inline bool equal2( const Vec2f & p, const Vec2f & q )
+{
+   return p[0] == q[0] && p[1] == q[1] ;
+}
+// -----------------------------------------------------------------------------
+
+bool check_vertex( const Vec2f & p, GeometryCheck & check )
+{
+   check.checked++ ;
+   if ( finite2( p ) )
+      return true ;
+   if ( std::isnan( p[0] ) || std::isnan( p[1] ) )
+      check.nan++ ;
+   else
+      check.inf++ ;
+   return false ;
+}
+// -----------------------------------------------------------------------------
+
+std::size_t first_invalid( const Vec2f * p, std::size_t n, bool check_repeated )
+{
+   static_assert( sizeof(Vec2f) == 2*sizeof(float), "Vec2f must be a packed xy pair" );
+   assert( p != nullptr || n == 0 );
+
+   if ( n == 0 )
+      return 0 ;
+   if ( ! finite2( p[0] ) )
+      return 0 ;
+
+   std::size_t i = 1 ;
+
+#if defined(__SSE__)
+   // two vertexes (i and i+1) in each vector, compared with (i-1 and i)
+   const __m128 zero = _mm_setzero_ps() ;
+   const float * f = p[0] ;
+
+   for( ; i+2 <= n ; i += 2 )
+   {
+      const __m128 a      = _mm_loadu_ps( f + 2*i ),
+                   finite = _mm_cmpeq_ps( _mm_sub_ps( a, a ), zero );
+      int bad = ~_mm_movemask_ps( finite ) & 0xF ;
+
+      if ( check_repeated )
+         bad |= _mm_movemask_ps( _mm_cmpeq_ps( a, _mm_loadu_ps( f + 2*(i-1) ) ) ) & 0xF ;
+
+      if ( bad != 0 )
+         break ; // (one of these two, found below)
+   }
+#endif
+
+   // remaining vertexes (all of them without SSE)
+   for( ; i < n ; i++ )
+   {
+      if ( ! finite2( p[i] ) )
+         return i ;
+      if ( check_repeated && equal2( p[i], p[i-1] ) )
+         return i ;
+   }
+   return n ;
+}
+// -----------------------------------------------------------------------------
+
+std::size_t compact_vertexes( Vec2f * p, std::size_t n, bool drop_repeated, GeometryCheck & check )
+{
+   const std::size_t first = first_invalid( p, n, drop_repeated );
+   check.checked += first ;
+   if ( first == n )
+      return n ;
+
+   // invalid vertexes found (rare): compact the rest of the array
+   std::size_t kept = first ;
+   for( std::size_t i = first ; i < n ; i++ )
+   {
+      if ( ! check_vertex( p[i], check ) )
+         continue ;
+      if ( drop_repeated && 0 < kept && equal2( p[i], p[kept-1] ) )
+      {
+         check.repeated++ ;
+         continue ;
+      }
+      p[kept++] = p[i] ;
+   }
+   return kept ;
+}
@@ -0,0 +1,79 @@
+// *********************************************************************
+// **
+// ** File: geometry_check.hpp
+// ** Validation of projected vertexes (NaN, infinite and repeated ones)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef GEOMETRY_CHECK_HPP
+#define GEOMETRY_CHECK_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "vector_templates.hpp"
+
+// *****************************************************************************
+// class GeometryCheck
+// Counts of the invalid vertexes found (and removed) in the projected vertexes
+// of an object: those with a NaN coordinate, those with an infinite one, and
+// those equal to the previous vertex (only looked for in polylines). Objects
+// keep the counts of their last projection, and sets of objects write one
+// summary line for each child with NaN or infinite vertexes ('report'), so the
+// output writers never see (nor check) invalid coordinates.
+
+class GeometryCheck
+{
+   public:
+   GeometryCheck() ;
+   void reset() ;
+
+   std::size_t removed() const { return nan + inf + repeated ; }
+   bool ok() const { return nan == 0 && inf == 0 ; } // (repeated vertexes are harmless)
+
+   // write a single line with the counts, for the object described by 'what'
+   void report( std::ostream & os, const std::string & what ) const ;
+
+   std::size_t checked,   // number of vertexes checked
+               nan,       // vertexes with a NaN coordinate
+               inf,       // vertexes with an infinite (and no NaN) coordinate
+               repeated ; // vertexes equal to the previous one
+} ;
+
+// -----------------------------------------------------------------------------
+// index of the first vertex in p[0..n-1] with a NaN or infinite coordinate (or,
+// if 'check_repeated', equal to the previous vertex), or 'n' when all of them are
+// valid. Vertexes are checked two at a time, with SSE, when available.
+
+std::size_t first_invalid( const Vec2f * p, std::size_t n, bool check_repeated ) ;
+
+// -----------------------------------------------------------------------------
+// remove from p[0..n-1] the invalid vertexes (as 'first_invalid'; a vertex is
+// repeated when it is equal to the previous vertex kept), keeping the order of
+// the others, add the counts to 'check' and return the number of vertexes kept.
+// Arrays without invalid vertexes are just read once.
+
+std::size_t compact_vertexes( Vec2f * p, std::size_t n, bool drop_repeated, GeometryCheck & check ) ;
+
+// -----------------------------------------------------------------------------
+// add a single vertex to the counts (true if it is valid, as for 'first_invalid'
+// without 'check_repeated')
+
+bool check_vertex( const Vec2f & p, GeometryCheck & check ) ;
+
+#endif
@@ -0,0 +1,285 @@
+// *********************************************************************
+// **
+// ** File: gzip_stream.cpp
+// ** Implementation of an output stream which writes gzip-compressed files
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "gzip_stream.hpp"
+
+// -----------------------------------------------------------------------------
+
+static double seconds_now()
+{
+   using namespace std::chrono ;
+   return duration<double>( steady_clock::now().time_since_epoch() ).count() ;
+}
+
+// *****************************************************************************
+// class CompressionStats
+// -----------------------------------------------------------------------------
+
+CompressionStats::CompressionStats()
+{
+   bytes_in        = 0 ;
+   bytes_out       = 0 ;
+   buffers         = 0 ;
+   deflate_seconds = 0.0 ;
+   wall_seconds    = 0.0 ;
+}
+// -----------------------------------------------------------------------------
+
+double CompressionStats::ratio() const
+{
+   return bytes_in == 0 ? 0.0 : double(bytes_out)/double(bytes_in) ;
+}
+// -----------------------------------------------------------------------------
+
+double CompressionStats::deflate_mb_per_sec() const
+{
+   return deflate_seconds <= 0.0 ? 0.0 : double(bytes_in)/(1024.0*1024.0*deflate_seconds) ;
+}
+
+// *****************************************************************************
+// class GzipPipeBuf
+// -----------------------------------------------------------------------------
+
+GzipPipeBuf::GzipPipeBuf( const std::string & path, int p_level,
+                          std::size_t p_buffer_size, std::size_t p_max_in_flight )
+{
+   assert( 0 < p_buffer_size && 0 < p_max_in_flight );
+
+   file_path     = path ;
+   level         = p_level ;
+   buffer_size   = p_buffer_size ;
+   max_in_flight = p_max_in_flight ;
+   in_flight     = 0 ;
+   finishing     = false ;
+   closed        = false ;
+   start_time    = seconds_now() ;
+
+   if ( level < Z_DEFAULT_COMPRESSION || Z_BEST_COMPRESSION < level )
+      throw std::runtime_error( "invalid gzip compression level for '" + path + "'" );
+
+   file = std::fopen( path.c_str(), "wb" );
+   if ( file == nullptr )
+      throw std::runtime_error( "cannot create '" + path + "': " + std::strerror( errno ) );
+
+   current.resize( buffer_size );
+   setp( current.data(), current.data() + current.size() );
+
+   worker = std::thread( &GzipPipeBuf::compression_thread, this );
+}
+// -----------------------------------------------------------------------------
+
+GzipPipeBuf::~GzipPipeBuf()
+{
+   try
+   {
+      close();
+   }
+   catch( ... ) // destructors must not throw: call 'close' to get errors
+   {
+   }
+}
+// -----------------------------------------------------------------------------
+
+void GzipPipeBuf::queue_current()
+{
+   const std::size_t used = std::size_t( pptr() - pbase() );
+   current.resize( used );
+   counters.bytes_in += used ;
+
+   std::unique_lock<std::mutex> lock( mtx );
+   cond.wait( lock, [this]{ return in_flight < max_in_flight || error ; } );
+   if ( error )
+      std::rethrow_exception( error );
+
+   if ( used > 0 )
+   {
+      queued.push_back( std::move( current ) );
+      in_flight++ ;
+      counters.buffers++ ;
+   }
+
+   // reuse a buffer already compressed, if there is one
+   if ( ! spare.empty() )
+   {
+      current = std::move( spare.front() );
+      spare.pop_front();
+   }
+   lock.unlock();
+   cond.notify_all();
+
+   current.resize( buffer_size );
+   setp( current.data(), current.data() + current.size() );
+}
+// -----------------------------------------------------------------------------
+
+GzipPipeBuf::int_type GzipPipeBuf::overflow( int_type c )
+{
+   if ( closed )
+      return traits_type::eof();
+   queue_current();
+   if ( ! traits_type::eq_int_type( c, traits_type::eof() ) )
+   {
+      *pptr() = traits_type::to_char_type( c );
+      pbump( 1 );
+   }
+   return traits_type::not_eof( c );
+}
+// -----------------------------------------------------------------------------
+
+int GzipPipeBuf::sync()
+{
+   // data is only forced out on 'close': a partial buffer is kept until it is full
+   return 0 ;
+}
+// -----------------------------------------------------------------------------
+
+void GzipPipeBuf::close()
+{
+   if ( closed )
+      return ;
+
+   // the thread must always be joined, even when the last buffer cannot be queued
+   std::exception_ptr queue_error ;
+   try
+   {
+      queue_current();
+   }
+   catch( ... )
+   {
+      queue_error = std::current_exception() ;
+   }
+   {
+      std::lock_guard<std::mutex> lock( mtx );
+      finishing = true ;
+   }
+   cond.notify_all();
+   worker.join();
+   closed = true ;
+   setp( nullptr, nullptr );
+
+   if ( std::fclose( file ) != 0 && ! error )
+      error = std::make_exception_ptr( std::runtime_error( "cannot write '" + file_path + "'" ) );
+   file = nullptr ;
+   counters.wall_seconds = seconds_now() - start_time ;
+
+   if ( ! error )
+      error = queue_error ;
+   if ( error )
+      std::rethrow_exception( error );
+}
+// -----------------------------------------------------------------------------
+
+void GzipPipeBuf::compression_thread()
+{
+   z_stream zs ;
+   std::memset( &zs, 0, sizeof(zs) );
+
+   // window bits 15+16: deflate with a gzip header and trailer
+   if ( deflateInit2( &zs, level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+   {
+      std::lock_guard<std::mutex> lock( mtx );
+      error = std::make_exception_ptr( std::runtime_error( "cannot initialize deflate for '" + file_path + "'" ) );
+      cond.notify_all();
+      return ;
+   }
+
+   std::vector<unsigned char> out( buffer_size + buffer_size/8 + 64 );
+   bool finished = false ;
+
+   while ( ! finished )
+   {
+      std::vector<char> in ;
+      bool popped = false ;
+      {
+         std::unique_lock<std::mutex> lock( mtx );
+         cond.wait( lock, [this]{ return ! queued.empty() || finishing ; } );
+         if ( ! queued.empty() )
+         {
+            in = std::move( queued.front() );
+            queued.pop_front();
+            popped = true ;
+         }
+         else
+            finished = true ; // 'finishing' set and nothing left: write the trailer
+      }
+
+      const double t0 = seconds_now() ;
+      bool write_ok = true ;
+
+      zs.next_in  = reinterpret_cast<Bytef *>( in.data() );
+      zs.avail_in = uInt( in.size() );
+      do
+      {
+         zs.next_out  = out.data() ;
+         zs.avail_out = uInt( out.size() );
+         deflate( &zs, finished ? Z_FINISH : Z_NO_FLUSH );
+         const std::size_t nout = out.size() - zs.avail_out ;
+         if ( nout > 0 && std::fwrite( out.data(), 1, nout, file ) != nout )
+            write_ok = false ;
+         counters.bytes_out += nout ;
+      }
+      while ( zs.avail_out == 0 );
+
+      counters.deflate_seconds += seconds_now() - t0 ;
+
+      std::lock_guard<std::mutex> lock( mtx );
+      if ( ! write_ok && ! error )
+      {
+         error = std::make_exception_ptr( std::runtime_error( "cannot write '" + file_path + "'" ) );
+         finished = true ;
+      }
+      if ( popped )
+      {
+         in.clear();
+         spare.push_back( std::move( in ) );
+         in_flight-- ;
+      }
+      cond.notify_all();
+   }
+
+   deflateEnd( &zs );
+}
+
+// *****************************************************************************
+// class GzipOStream
+// -----------------------------------------------------------------------------
+
+GzipOStream::GzipOStream( const std::string & path, int level )
+
+: std::ostream( &buf ),
+  buf( path, level )
+{
+}
+// -----------------------------------------------------------------------------
+
+void GzipOStream::close()
+{
+   flush();
+   buf.close();
+}
@@ -0,0 +1,119 @@
+// *********************************************************************
+// **
+// ** File: gzip_stream.hpp
+// ** Declarations for an output stream which writes gzip-compressed files
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef GZIP_STREAM_HPP
+#define GZIP_STREAM_HPP
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// *****************************************************************************
+// class CompressionStats
+// throughput counters for a compressed output stream
+
+class CompressionStats
+{
+   public:
+   CompressionStats() ;
+
+   unsigned long long bytes_in,       // uncompressed bytes written by the emitters
+                      bytes_out,      // compressed bytes written to the file
+                      buffers ;       // number of buffers handed to the compression thread
+   double             deflate_seconds,// time spent by the compression thread (deflate + write)
+                      wall_seconds ;  // time from opening to closing the stream
+
+   double ratio() const ;             // bytes_out/bytes_in
+   double deflate_mb_per_sec() const ;// uncompressed MB compressed per second of deflate time
+} ;
+
+// *****************************************************************************
+// class GzipPipeBuf
+// A stream buffer which writes a gzip file. Emitters fill fixed-size buffers,
+// full buffers are queued and a dedicated thread deflates and writes them, so
+// compression overlaps with the emission. At most 'max_in_flight' buffers are
+// queued at any time (the emitter waits when the compression thread lags).
+// Throws std::runtime_error if the file cannot be created or written.
+
+class GzipPipeBuf : public std::streambuf
+{
+   public:
+   GzipPipeBuf( const std::string & path, int level,
+                std::size_t p_buffer_size = 256*1024, std::size_t p_max_in_flight = 4 );
+   virtual ~GzipPipeBuf() ;
+
+   void close() ;   // flush, finish the gzip stream and wait for the thread
+   const CompressionStats & stats() const { return counters ; }
+
+   protected:
+   virtual int_type overflow( int_type c ) ;
+   virtual int sync() ;
+
+   private:
+   GzipPipeBuf( const GzipPipeBuf & ) = delete ;
+   GzipPipeBuf & operator = ( const GzipPipeBuf & ) = delete ;
+
+   void queue_current() ;      // hand the current buffer to the thread, get a free one
+   void compression_thread() ; // body of the compression thread
+
+   std::string        file_path ;
+   std::FILE *        file ;
+   int                level ;
+   std::size_t        buffer_size,
+                      max_in_flight ;
+   std::vector<char>  current ;      // buffer being filled by the emitters
+
+   std::mutex                       mtx ;
+   std::condition_variable          cond ;
+   std::deque< std::vector<char> >  queued, // full buffers, waiting to be compressed
+                                    spare ; // empty buffers, ready to be reused
+   std::size_t                      in_flight ;
+   bool                             finishing, closed ;
+   std::exception_ptr               error ;  // first error found by the thread
+   std::thread                      worker ;
+
+   CompressionStats   counters ;
+   double             start_time ;
+} ;
+
+// *****************************************************************************
+// class GzipOStream
+// an std::ostream writing to a GzipPipeBuf
+
+class GzipOStream : public std::ostream
+{
+   public:
+   GzipOStream( const std::string & path, int level ) ;
+   void close() ;
+   const CompressionStats & stats() const { return buf.stats() ; }
+
+   private:
+   GzipPipeBuf buf ;
+} ;
+
+#endif
@@ -1,12 +1,66 @@
 
 #include "figures.hpp"
+#include "render_daemon.hpp"
+#include "parallel.hpp"
+#include "benchmark.hpp"
 
 int main( int argc, char * argv [] )
 {
   using namespace std ;
 
+  if ( 3 <= argc && std::string( argv[1] ) == "--daemon" )
+  { try
+    { const unsigned workers = 3 < argc ? unsigned( std::stoi( argv[3] ) ) : num_worker_threads() ;
+      RenderDaemon daemon( argv[2], workers );
+      cout << "listening on " << argv[2] << " (" << workers << " workers)" << endl ;
+      daemon.run();
+    }
+    catch ( std::exception & e )
+    { cerr << e.what() << endl ;
+      return 1 ;
+    }
+    return 0 ;
+  }
+
+  if ( 3 <= argc && std::string( argv[1] ) == "--psa-sweep" )
+  { try
+    { PSASweep sweep ;
+      const unsigned width = 3 < argc ? unsigned( std::stoi( argv[3] ) ) : 1024 ;
+      const std::size_t n  = sweep.run( argv[2], width );
+      cout << n << " PSA figures written (" << argv[2] << ")" << endl ;
+    }
+    catch ( std::exception & e )
+    { cerr << e.what() << endl ;
+      return 1 ;
+    }
+    return 0 ;
+  }
+
+  if ( 2 <= argc && std::string( argv[1] ) == "--bench" )
+  { try
+    { ScalingBenchmark bench ;
+      if ( 2 < argc )
+        bench.sizes = ScalingBenchmark::defaultSizes( std::size_t( std::stod( argv[2] ) ) );
+      bench.run( cout );
+    }
+    catch ( std::exception & e )
+    { cerr << e.what() << endl ;
+      return 1 ;
+    }
+    return 0 ;
+  }
+
   if ( argc < 3 )
-  { cerr << "please specify figure number and name for .svg output file" << endl << flush ;
+  { cerr << "please specify figure number and names for .svg (or .svgz, .png or .pdf) output files" << endl
+         << "(all the files are written from a single traversal; for .png files, the width" << endl
+         << "in pixels can be given as a last, numeric, argument; with '-m manifest', files" << endl
+         << "already written from an identical figure are skipped; '-p single|mixed|double'" << endl
+         << "selects the precision of the projection math, see 'Precision'; with '-z baseline'," << endl
+         << "the bytes of the SVG output are reported by kind and checked against the baseline" << endl
+         << "of the figure, failing when they grow more than '-zt fraction', 0.01 by default)" << endl
+         << "or '--daemon <socket path> [workers]' to serve render requests (see render_daemon.hpp)" << endl
+         << "or '--psa-sweep <name pattern with %> [width]' to render all the PSA variants (see PSASweep)" << endl
+         << "or '--bench [max vertexes]' to measure synthetic figures of growing size (see ScalingBenchmark)" << endl << flush ;
     return 1 ;
   }
 
@@ -19,52 +73,117 @@ int main( int argc, char * argv [] )
     return 1 ;
   }
 
-  std::string arg2( argv[2] );
+  std::vector<std::string> nombres_arch ;
+  unsigned width_px = 1024 ;
+
+  std::string manifest_path ;
+  Precision   precision = Precision::Single ;
+  std::string size_baseline_path ;
+  double      size_threshold = 0.01 ;
+
+  for( int i = 2 ; i < argc ; i++ )
+  { const std::string arg( argv[i] );
+    if ( arg == "-m" && i+1 < argc )
+    { manifest_path = argv[++i] ;
+      continue ;
+    }
+    if ( arg == "-z" && i+1 < argc )
+    { size_baseline_path = argv[++i] ;
+      continue ;
+    }
+    if ( arg == "-zt" && i+1 < argc )
+    { const std::string t( argv[++i] );
+      try
+      { size_threshold = std::stod( t );
+      }
+      catch ( std::exception e )
+      { size_threshold = -1.0 ;
+      }
+      if ( ! ( 0.0 <= size_threshold ) )
+      { cerr << "invalid size threshold (" << t << "), it must be a non-negative fraction" << endl ;
+        return 1 ;
+      }
+      continue ;
+    }
+    if ( arg == "-p" && i+1 < argc )
+    { const std::string p( argv[++i] );
+      if ( p == "single" )
+        precision = Precision::Single ;
+      else if ( p == "mixed" )
+        precision = Precision::Mixed ;
+      else if ( p == "double" )
+        precision = Precision::Double ;
+      else
+      { cerr << "invalid precision (" << p << "), it must be 'single', 'mixed' or 'double'" << endl ;
+        return 1 ;
+      }
+      continue ;
+    }
+    if ( arg.empty() || arg.find_first_not_of( "0123456789" ) != std::string::npos )
+    { nombres_arch.push_back( arg );
+      continue ;
+    }
+    try
+    { width_px = unsigned( std::stoi( arg ) );
+    }
+    catch ( std::exception e )
+    { width_px = 0 ;
+    }
+    if ( width_px == 0 || i+1 < argc || nombres_arch.empty() )
+    { cerr << "invalid width in pixels (" << arg << "), it must be a positive number given after the file names" << endl ;
+      return 1 ;
+    }
+  }
 
   //test_svg_simple( arg1 );
   //test_figura_estrella( arg1 );
   //test_poligonos_estilos( arg1 );
 
-  Figure * fig = nullptr ;
-
-  switch( arg1 )
-  {
-    case 1 :
-      fig = new Figure1_HatBox(  );
-      break ;
-    case 2 :
-      fig = new Figure2_ParamCil(  );
-      break ;
-    case 3 :
-      fig = new Figure3_ParamConPol(  );
-      break ;
-    case 4 :
-      fig = new Figure4_EllipseSectorZ(  );
-      break ;
-    case 5 :
-      fig = new Figure5_EllipseSectorRadial() ;
-      break ;
-    case 6 :
-      fig = new Figure6_SuplPara();
-      break ;
-    case 7 :
-      fig = new Figure7_PSA_shape();
-      break ;
-    case 8 :
-      fig = new Figure8_PSA_ellipse();
-      break ;
-    case 9 :
-      fig = new Figure9_PSA_ellipse_lune();
-      break ;
-    case 10 :
-      fig = new Figure10_PSA_lune();
-      break ;
-    default:
-      cerr << "first argument is an out of range number (" << argv[1] << ")" << endl ;
-      return 1 ;
+  Figure * fig = new_figure( arg1 );
+  if ( fig == nullptr )
+  { cerr << "first argument is an out of range number (" << argv[1] << ")" << endl ;
+    return 1 ;
+  }
+
+  SVGSizeStats size_stats ;
+  fig->manifest_path = manifest_path ;
+  fig->cam.precision = precision ;
+  if ( ! size_baseline_path.empty() )
+    fig->size_stats = &size_stats ;
+  try
+  { fig->draw( nombres_arch, width_px );
+  }
+  catch ( std::exception & e )
+  { cerr << e.what() << endl ;
+    return 1 ;
+  }
+
+  for( const std::string & nombre_arch : fig->skipped_files )
+    cout << nombre_arch << ": unchanged, not written" << endl ;
+
+  if ( 0 < fig->svgz_stats.bytes_in )
+  { const CompressionStats & st = fig->svgz_stats ;
+    cout << "svgz: " << st.bytes_in << " bytes --> " << st.bytes_out << " bytes (ratio "
+         << st.ratio() << "), " << st.buffers << " buffers, deflate "
+         << st.deflate_mb_per_sec() << " MB/s, total " << st.wall_seconds << " s" << endl ;
   }
 
-  fig->drawSVG( arg2 );
+  if ( ! size_baseline_path.empty() )
+  { if ( size_stats.total() == 0 )
+    { cout << "WARNING: no SVG output written, output size not checked" << endl ;
+      return 0 ;
+    }
+    size_stats.report( cout );
+    try
+    { SizeBaseline baseline( size_baseline_path );
+      if ( ! baseline.check( std::string("fig") + argv[1], size_stats, size_threshold, cout ) )
+        return 1 ;
+    }
+    catch ( std::exception & e )
+    { cerr << e.what() << endl ;
+      return 1 ;
+    }
+  }
 
   return 0 ;
 
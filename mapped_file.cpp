@@ -0,0 +1,259 @@
+// *********************************************************************
+// **
+// ** File: mapped_file.cpp
+// ** Implementation for memory-mapped files (read-only inputs and written outputs)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+// -----------------------------------------------------------------------------
+
+static std::runtime_error mapping_error( const std::string & what, const std::string & path )
+{
+   return std::runtime_error( what + " '" + path + "': " + std::strerror( errno ) );
+}
+
+// *****************************************************************************
+// class MappedFile
+// -----------------------------------------------------------------------------
+
+MappedFile::MappedFile( const std::string & p_path )
+{
+   file_path = p_path ;
+   base      = nullptr ;
+   length    = 0 ;
+
+   const int fd = ::open( file_path.c_str(), O_RDONLY );
+   if ( fd < 0 )
+      throw mapping_error( "cannot open", file_path );
+
+   struct stat st ;
+   if ( ::fstat( fd, &st ) != 0 )
+   {
+      const std::runtime_error e = mapping_error( "cannot stat", file_path );
+      ::close( fd );
+      throw e ;
+   }
+   length = std::size_t( st.st_size );
+
+   if ( length > 0 )
+   {
+      void * p = ::mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( p == MAP_FAILED )
+      {
+         const std::runtime_error e = mapping_error( "cannot map", file_path );
+         ::close( fd );
+         throw e ;
+      }
+      base = p ;
+      // vertex arrays are always read front to back: let the kernel read ahead
+      ::madvise( base, length, MADV_SEQUENTIAL );
+   }
+   ::close( fd ); // the mapping stays valid after closing the descriptor
+}
+// -----------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+   if ( base != nullptr )
+      ::munmap( base, length );
+}
+
+// *****************************************************************************
+// class MappedOutBuf
+// -----------------------------------------------------------------------------
+
+static std::size_t page_round( std::size_t n )
+{
+   const std::size_t page = std::size_t( ::sysconf( _SC_PAGESIZE ) );
+   return std::max( page, ((n+page-1)/page)*page );
+}
+// -----------------------------------------------------------------------------
+
+MappedOutBuf::MappedOutBuf( const std::string & p_path, std::size_t size_estimate )
+{
+   file_path   = p_path ;
+   base        = nullptr ;
+   length      = 0 ;
+   num_growths = 0 ;
+
+   fd = ::open( file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+   if ( fd < 0 )
+      throw mapping_error( "cannot create", file_path );
+   try
+   {
+      reserve( size_estimate );
+   }
+   catch( ... )
+   {
+      ::close( fd );
+      throw ;
+   }
+   num_growths = 0 ; // (the first mapping is not a growth)
+}
+// -----------------------------------------------------------------------------
+
+MappedOutBuf::~MappedOutBuf()
+{
+   try
+   {
+      close();
+   }
+   catch( ... )
+   {
+   }
+}
+// -----------------------------------------------------------------------------
+
+std::size_t MappedOutBuf::size() const
+{
+   return ( base != nullptr ) ? std::size_t( pptr()-pbase() ) : 0 ;
+}
+// -----------------------------------------------------------------------------
+
+void MappedOutBuf::advance( std::size_t n )
+{
+   while ( n > 0 )
+   {
+      const std::size_t step = std::min( n, std::size_t( INT_MAX ) );
+      pbump( int( step ) );
+      n -= step ;
+   }
+}
+// -----------------------------------------------------------------------------
+
+void MappedOutBuf::reserve( std::size_t min_length )
+{
+   const std::size_t used       = size(),
+                     new_length = page_round( std::max( min_length, 2*length ) );
+
+   // reserve the blocks, so writing to the pages cannot fail later
+   const int err = ::posix_fallocate( fd, 0, off_t( new_length ) );
+   if ( err != 0 )
+   {
+      errno = err ;
+      throw mapping_error( "cannot grow", file_path );
+   }
+
+   void * p ;
+#if defined(__linux__)
+   p = ( base == nullptr )
+       ? ::mmap( nullptr, new_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )
+       : ::mremap( base, length, new_length, MREMAP_MAYMOVE );
+#else
+   if ( base != nullptr )
+      ::munmap( base, length );
+   base = nullptr ;
+   p = ::mmap( nullptr, new_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+#endif
+   if ( p == MAP_FAILED )
+      throw mapping_error( "cannot map", file_path );
+
+   base   = static_cast<char *>( p );
+   length = new_length ;
+   num_growths++ ;
+
+   setp( base, base+length );
+   advance( used );
+}
+// -----------------------------------------------------------------------------
+
+MappedOutBuf::int_type MappedOutBuf::overflow( int_type c )
+{
+   if ( fd < 0 )
+      return traits_type::eof();
+   if ( traits_type::eq_int_type( c, traits_type::eof() ) )
+      return traits_type::not_eof( c );
+   reserve( length+1 );
+   *pptr() = traits_type::to_char_type( c );
+   pbump( 1 );
+   return c ;
+}
+// -----------------------------------------------------------------------------
+
+std::streamsize MappedOutBuf::xsputn( const char * s, std::streamsize n )
+{
+   if ( fd < 0 )
+      return 0 ;
+   const std::size_t count = std::size_t( n );
+   if ( std::size_t( epptr()-pptr() ) < count )
+      reserve( size()+count );  // (a single growth for long strings)
+   std::memcpy( pptr(), s, count );
+   advance( count );
+   return n ;
+}
+// -----------------------------------------------------------------------------
+
+int MappedOutBuf::sync()
+{
+   // the data is already in the page cache (the kernel writes it back)
+   return 0 ;
+}
+// -----------------------------------------------------------------------------
+
+void MappedOutBuf::close()
+{
+   if ( fd < 0 )
+      return ;
+
+   const std::size_t used = size() ;
+   if ( base != nullptr )
+      ::munmap( base, length );
+   base = nullptr ;
+   setp( nullptr, nullptr );
+
+   const bool ok = ::ftruncate( fd, off_t( used ) ) == 0 ;
+   const int  err = errno ;
+   ::close( fd );
+   fd = -1 ;
+
+   if ( ! ok )
+   {
+      errno = err ;
+      throw mapping_error( "cannot truncate", file_path );
+   }
+}
+
+// *****************************************************************************
+// class MappedOStream
+// -----------------------------------------------------------------------------
+
+MappedOStream::MappedOStream( const std::string & path, std::size_t size_estimate )
+
+: std::ostream( &buf ),
+  buf( path, size_estimate )
+{
+}
+// -----------------------------------------------------------------------------
+
+void MappedOStream::close()
+{
+   flush();
+   buf.close();
+}
@@ -0,0 +1,112 @@
+// *********************************************************************
+// **
+// ** File: mapped_file.hpp
+// ** Declarations for memory-mapped files (read-only inputs and written outputs)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+// *****************************************************************************
+// class MappedFile
+// A whole file mapped read-only into memory (POSIX mmap). The contents are
+// paged in on demand by the kernel, nothing is copied or parsed.
+// Throws std::runtime_error when the file cannot be opened or mapped.
+
+class MappedFile
+{
+   public:
+   MappedFile( const std::string & p_path ) ;
+   ~MappedFile() ;
+
+   const void * data() const { return base ; }
+   std::size_t  size() const { return length ; }
+   const std::string & path() const { return file_path ; }
+
+   private:
+   MappedFile( const MappedFile & ) = delete ;
+   MappedFile & operator = ( const MappedFile & ) = delete ;
+
+   std::string  file_path ;
+   void *       base ;    // start of the mapping (nullptr for empty files)
+   std::size_t  length ;  // file length in bytes
+} ;
+
+// *****************************************************************************
+// class MappedOutBuf
+// A stream buffer which writes a file through a shared read-write mapping: the
+// put area is the mapping itself, so emitters format straight into the page
+// cache (no copy through a stream buffer and a 'write' call). The file is sized
+// from an estimate of the output size (reserved with 'posix_fallocate', so a full
+// disk is an error and not a SIGBUS), the mapping is grown (at least doubled)
+// when the estimate falls short, and the file is truncated to the exact size by
+// 'close'. Throws std::runtime_error when the file cannot be created, grown or
+// truncated.
+
+class MappedOutBuf : public std::streambuf
+{
+   public:
+   MappedOutBuf( const std::string & p_path, std::size_t size_estimate ) ;
+   virtual ~MappedOutBuf() ; // (closes the file, errors are ignored)
+
+   void close() ;                              // unmap and truncate to the bytes written
+   std::size_t size() const ;                  // bytes written so far
+   std::size_t capacity() const { return length ; } // current size of the mapping
+   unsigned growths() const { return num_growths ; } // number of times the mapping was grown
+   const std::string & path() const { return file_path ; }
+
+   protected:
+   virtual int_type overflow( int_type c ) ;
+   virtual std::streamsize xsputn( const char * s, std::streamsize n ) ;
+   virtual int sync() ;
+
+   private:
+   MappedOutBuf( const MappedOutBuf & ) = delete ;
+   MappedOutBuf & operator = ( const MappedOutBuf & ) = delete ;
+
+   void reserve( std::size_t min_length ) ;  // grow the file and the mapping
+   void advance( std::size_t n ) ;           // move the put pointer (pbump takes an int)
+
+   std::string  file_path ;
+   int          fd ;       // file descriptor (-1 when closed)
+   char *       base ;     // start of the mapping
+   std::size_t  length ;   // mapping (and file) length in bytes
+   unsigned     num_growths ;
+} ;
+
+// *****************************************************************************
+// class MappedOStream
+// an std::ostream writing to a MappedOutBuf
+
+class MappedOStream : public std::ostream
+{
+   public:
+   MappedOStream( const std::string & path, std::size_t size_estimate ) ;
+   void close() ;
+   const MappedOutBuf & buffer() const { return buf ; }
+
+   private:
+   MappedOutBuf buf ;
+} ;
+
+#endif
@@ -0,0 +1,146 @@
+// *********************************************************************
+// **
+// ** File: mapping_kernels.cpp
+// ** Batch mappings of vertexes onto the sphere, the cylinders and the
+// ** horizontal plane
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cassert>
+#include "mapping_kernels.hpp"
+
+#if defined(__SSE__)
+
+// Aux functions
+
+// -----------------------------------------------------------------------------
+// load four consecutive xyz triples (12 floats) as three vectors with the
+// x, y and z coordinates (a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3)
+
+static inline void load4( const Vec3f * v, __m128 & x, __m128 & y, __m128 & z )
+{
+   const float * p = v[0] ;
+   const __m128 a = _mm_loadu_ps( p ),
+                b = _mm_loadu_ps( p+4 ),
+                c = _mm_loadu_ps( p+8 );
+
+   x = _mm_shuffle_ps( a, _mm_shuffle_ps( b, c, _MM_SHUFFLE(0,1,0,2) ), _MM_SHUFFLE(2,0,3,0) );
+   y = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE(0,0,1,1) ),
+                       _mm_shuffle_ps( b, c, _MM_SHUFFLE(2,2,3,3) ), _MM_SHUFFLE(2,0,2,0) );
+   z = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE(1,1,2,2) ),
+                       _mm_shuffle_ps( c, c, _MM_SHUFFLE(3,3,0,0) ), _MM_SHUFFLE(2,0,2,0) );
+}
+// -----------------------------------------------------------------------------
+
+static inline void store4( Vec3f * v, __m128 x, __m128 y, __m128 z )
+{
+   alignas(16) float xs[4], ys[4], zs[4] ;
+   _mm_store_ps( xs, x );
+   _mm_store_ps( ys, y );
+   _mm_store_ps( zs, z );
+   for( unsigned k = 0 ; k < 4 ; k++ )
+      v[k] = Vec3f( xs[k], ys[k], zs[k] );
+}
+// -----------------------------------------------------------------------------
+// four reciprocal square roots (as 'rsqrt_refined')
+
+static inline __m128 rsqrt4_refined( __m128 x )
+{
+   const __m128 y = _mm_rsqrt_ps( x );
+   const __m128 t = _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), x ), y ), y );
+   return _mm_mul_ps( y, _mm_sub_ps( _mm_set1_ps( 1.5f ), t ) );
+}
+// -----------------------------------------------------------------------------
+
+static inline __m128 select4( __m128 mask, __m128 if_true, __m128 if_false )
+{
+   return _mm_or_ps( _mm_and_ps( mask, if_true ), _mm_andnot_ps( mask, if_false ) );
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+
+void apply_map_batch( VertexMap m, Vec3f * v, std::size_t n )
+{
+   static_assert( sizeof(Vec3f) == 3*sizeof(float), "Vec3f must be a packed xyz triple" );
+   assert( v != nullptr || n == 0 );
+
+   std::size_t i = 0 ;
+
+   if ( m == VertexMap::FlattenToY0 )
+   {
+      for( ; i < n ; i++ )
+         v[i][1] = 0.0f ;
+      return ;
+   }
+
+#if defined(__SSE__)
+   const __m128 zero = _mm_setzero_ps() ;
+
+   for( ; i+4 <= n ; i += 4 )
+   {
+      __m128 x, y, z ;
+      load4( v+i, x, y, z );
+
+      const __m128 xx = _mm_mul_ps( x, x ),
+                   yy = _mm_mul_ps( y, y ),
+                   zz = _mm_mul_ps( z, z );
+      switch( m )
+      {
+         case VertexMap::Normalize :
+         {
+            const __m128 f = rsqrt4_refined( _mm_add_ps( _mm_add_ps( xx, yy ), zz ) );
+            x = _mm_mul_ps( x, f );
+            y = _mm_mul_ps( y, f );
+            z = _mm_mul_ps( z, f );
+            break ;
+         }
+         case VertexMap::ClipToHemisphere :
+         {
+            const __m128 below = _mm_cmplt_ps( y, zero ),
+                         f     = rsqrt4_refined( _mm_add_ps( xx, zz ) );
+            x = select4( below, _mm_mul_ps( x, f ), x );
+            y = select4( below, zero, y );
+            z = select4( below, _mm_mul_ps( z, f ), z );
+            break ;
+         }
+         case VertexMap::ToYCylinder :
+         {
+            const __m128 f = rsqrt4_refined( _mm_add_ps( xx, zz ) );
+            x = _mm_mul_ps( x, f );
+            z = _mm_mul_ps( z, f );
+            break ;
+         }
+         case VertexMap::ToZCylinder :
+         {
+            const __m128 f = rsqrt4_refined( _mm_add_ps( xx, yy ) );
+            x = _mm_mul_ps( x, f );
+            y = _mm_mul_ps( y, f );
+            break ;
+         }
+         default :
+            break ;
+      }
+      store4( v+i, x, y, z );
+   }
+#endif
+
+   // remaining vertexes (all of them without SSE)
+   for( ; i < n ; i++ )
+      apply_map( m, v[i] );
+}
@@ -0,0 +1,122 @@
+// *********************************************************************
+// **
+// ** File: mapping_kernels.hpp
+// ** Declarations for the mappings of vertexes onto the sphere, the
+// ** cylinders and the horizontal plane (per vertex and batch versions)
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef MAPPING_KERNELS_HPP
+#define MAPPING_KERNELS_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "vector_templates.hpp"
+
+// *****************************************************************************
+// mappings of vertexes:
+//   Normalize        : project onto the unit sphere (p/|p|)
+//   ClipToHemisphere : points with y < 0 are moved to the equator, (x,0,z)/|(x,0,z)|
+//   FlattenToY0      : project onto the horizontal plane Y=0, (x,0,z)
+//   ToYCylinder      : project onto the unit cylinder around Y, (x/r,y,z/r), r=|(x,z)|
+//   ToZCylinder      : project onto the unit cylinder around Z, (x/r,y/r,z), r=|(x,y)|
+
+enum class VertexMap : unsigned char
+{
+   Normalize, ClipToHemisphere, FlattenToY0, ToYCylinder, ToZCylinder
+} ;
+
+// *****************************************************************************
+// Float mappings use an approximate reciprocal square root (SSE 'rsqrt', 12
+// bits) refined with one Newton-Raphson step, y*(1.5-0.5*x*y*y), instead of a
+// square root and a divide. The relative error of the refined value is below
+// 2^-21 (about 4.8e-7, a few float ulps), so mapped vertexes are within 5e-7
+// (relative) of the exact ones. The per vertex and the batch versions do the
+// same operations in the same order, so they give identical results (but the
+// 'rsqrt' approximation may differ between processor vendors).
+// Double mappings are exact (sqrt and divide).
+
+inline float rsqrt_refined( float x )
+{
+#if defined(__SSE__)
+   const float y = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( x ) ) );
+#else
+   const float y = 1.0f/std::sqrt( x );
+#endif
+   return y*( 1.5f - ((0.5f*x)*y)*y ) ;
+}
+// -----------------------------------------------------------------------------
+// inverse length of (a,b,c) (a^2+b^2+c^2 evaluated as (a*a+b*b)+c*c)
+
+inline float inv_length( float a, float b, float c )
+{
+   return rsqrt_refined( (a*a+b*b)+c*c );
+}
+inline double inv_length( double a, double b, double c )
+{
+   return 1.0/std::sqrt( (a*a+b*b)+c*c );
+}
+// -----------------------------------------------------------------------------
+// apply a mapping to a single vertex
+
+template< class T >
+inline void apply_map( VertexMap m, VectorTempl3<T> & v )
+{
+   switch( m )
+   {
+      case VertexMap::Normalize :
+      {
+         const T f = inv_length( v[0], v[1], v[2] );
+         v = VectorTempl3<T>( v[0]*f, v[1]*f, v[2]*f );
+         break ;
+      }
+      case VertexMap::ClipToHemisphere :
+         if ( v[1] < T(0) )
+         {
+            const T f = inv_length( v[0], T(0), v[2] );
+            v = VectorTempl3<T>( v[0]*f, T(0), v[2]*f );
+         }
+         break ;
+      case VertexMap::FlattenToY0 :
+         v = VectorTempl3<T>( v[0], T(0), v[2] );
+         break ;
+      case VertexMap::ToYCylinder :
+      {
+         const T f = inv_length( v[0], v[2], T(0) );
+         v = VectorTempl3<T>( v[0]*f, v[1], v[2]*f );
+         break ;
+      }
+      case VertexMap::ToZCylinder :
+      {
+         const T f = inv_length( v[0], v[1], T(0) );
+         v = VectorTempl3<T>( v[0]*f, v[1]*f, v[2] );
+         break ;
+      }
+   }
+}
+// -----------------------------------------------------------------------------
+// apply a mapping to 'n' consecutive vertexes, in place (SSE, four vertexes at
+// a time, when available)
+
+void apply_map_batch( VertexMap m, Vec3f * v, std::size_t n ) ;
+
+#endif
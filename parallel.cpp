@@ -0,0 +1,103 @@
+// *********************************************************************
+// **
+// ** File: parallel.cpp
+// ** Implementation of simple fork-join parallel loops
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+static std::atomic<unsigned> requested_threads( 0 ) ; // 0 --> hardware concurrency
+static thread_local bool     inside_parallel_loop = false ;
+
+// -----------------------------------------------------------------------------
+
+unsigned num_worker_threads()
+{
+   const unsigned n = requested_threads.load() ;
+   if ( n > 0 )
+      return n ;
+   return std::max( 1u, std::thread::hardware_concurrency() );
+}
+// -----------------------------------------------------------------------------
+
+void set_num_worker_threads( unsigned n )
+{
+   requested_threads.store( n );
+}
+// -----------------------------------------------------------------------------
+
+std::size_t parallel_num_chunks( std::size_t n, std::size_t min_chunk )
+{
+   if ( inside_parallel_loop || n == 0 )
+      return 1 ;
+   const std::size_t max_chunks = n/std::max( std::size_t(1), min_chunk ) ;
+   return std::max( std::size_t(1), std::min( max_chunks, std::size_t( num_worker_threads() ) ) );
+}
+// -----------------------------------------------------------------------------
+
+void parallel_for_chunks( std::size_t n, std::size_t min_chunk,
+              const std::function< void( std::size_t, std::size_t, std::size_t ) > & f )
+{
+   const std::size_t nc = parallel_num_chunks( n, min_chunk );
+
+   if ( nc == 1 )
+   {
+      f( 0, 0, n );
+      return ;
+   }
+
+   std::exception_ptr error ;
+   std::mutex         error_mutex ;
+
+   auto run_chunk = [&]( std::size_t ic )
+   {
+      const std::size_t begin = (n*ic)/nc,
+                        end   = (n*(ic+1))/nc ;
+      inside_parallel_loop = true ;
+      try
+      {
+         f( ic, begin, end );
+      }
+      catch( ... )
+      {
+         std::lock_guard<std::mutex> lock( error_mutex );
+         if ( ! error )
+            error = std::current_exception() ;
+      }
+      inside_parallel_loop = false ;
+   };
+
+   // chunk 0 runs on the calling thread, the others on new threads
+   std::vector<std::thread> threads ;
+   threads.reserve( nc-1 );
+   for( std::size_t ic = 1 ; ic < nc ; ic++ )
+      threads.push_back( std::thread( run_chunk, ic ) );
+   run_chunk( 0 );
+   for( std::thread & t : threads )
+      t.join() ;
+
+   if ( error )
+      std::rethrow_exception( error );
+}
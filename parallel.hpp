@@ -0,0 +1,46 @@
+// *********************************************************************
+// **
+// ** File: parallel.hpp
+// ** Declarations for simple fork-join parallel loops
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+
+// number of threads used by parallel loops (by default, the hardware concurrency)
+unsigned num_worker_threads() ;
+
+// set the number of threads used by parallel loops (0 restores the default)
+void set_num_worker_threads( unsigned n ) ;
+
+// number of chunks 'parallel_for_chunks' splits [0,n) into, for a given
+// minimum chunk size (it is 1 when the loop is going to be run serially)
+std::size_t parallel_num_chunks( std::size_t n, std::size_t min_chunk ) ;
+
+// split [0,n) into 'parallel_num_chunks(n,min_chunk)' contiguous chunks, and call
+// f( chunk_index, begin, end ) once for each chunk, spreading the calls on the
+// worker threads. Returns after all chunks are done. Runs serially on the calling
+// thread when there is just one chunk or when called from inside another
+// parallel loop. An exception thrown by 'f' is re-thrown on the calling thread.
+void parallel_for_chunks( std::size_t n, std::size_t min_chunk,
+              const std::function< void( std::size_t, std::size_t, std::size_t ) > & f ) ;
+
+#endif
@@ -0,0 +1,351 @@
+// *********************************************************************
+// **
+// ** File: pdf_writer.cpp
+// ** Implementation of a writer of single-page vector PDF files
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "pdf_writer.hpp"
+
+// Aux functions
+
+// -----------------------------------------------------------------------------
+// a number as PDF text: fixed notation (PDF has no exponents), no trailing zeros
+
+static std::string pdf_number( float v )
+{
+   if ( ! std::isfinite( v ) )
+      v = 0.0f ;
+   char buf[64] ;
+   std::snprintf( buf, sizeof(buf), "%.5f", double(v) );
+   std::string s( buf );
+   while ( s.back() == '0' )
+      s.pop_back() ;
+   if ( s.back() == '.' )
+      s.pop_back() ;
+   if ( s == "-0" )
+      s = "0" ;
+   return s ;
+}
+// -----------------------------------------------------------------------------
+// a stream object (with its dictionary entries), Flate-compressed
+
+static std::string pdf_stream( const std::string & dict_entries, const std::string & data )
+{
+   uLongf zlen = compressBound( data.size() );
+   std::string zdata( zlen, '\0' );
+   if ( compress2( reinterpret_cast<Bytef *>( &zdata[0] ), &zlen,
+                   reinterpret_cast<const Bytef *>( data.data() ), data.size(), 6 ) != Z_OK )
+      throw std::runtime_error( "cannot compress PDF stream" );
+   zdata.resize( zlen );
+
+   return "<< " + dict_entries + " /Length " + std::to_string( zlen ) + " /Filter /FlateDecode >>\n"
+          "stream\n" + zdata + "\nendstream" ;
+}
+// -----------------------------------------------------------------------------
+// a radial shading dictionary (two circles: focal point with radius 0, and the
+// gradient circle), with 'n' color components going from 'c0' to 'c1'
+
+static std::string radial_shading( const RadialGradient & g, const char * color_space,
+                                   const float * c0, const float * c1, unsigned n )
+{
+   std::string s = std::string( "<< /ShadingType 3 /ColorSpace /" ) + color_space +
+      " /Coords [" + pdf_number( g.fx ) + " " + pdf_number( g.fy ) + " 0 " +
+                     pdf_number( g.cx ) + " " + pdf_number( g.cy ) + " " + pdf_number( g.r ) + "]" +
+      " /Extend [true true] /Function << /FunctionType 2 /Domain [0 1] /C0 [" ;
+   for( unsigned i = 0 ; i < n ; i++ )
+      s += (i > 0 ? " " : "") + pdf_number( c0[i] );
+   s += "] /C1 [" ;
+   for( unsigned i = 0 ; i < n ; i++ )
+      s += (i > 0 ? " " : "") + pdf_number( c1[i] );
+   return s + "] /N 1 >> >>" ;
+}
+
+// *****************************************************************************
+// class PDFWriter
+// -----------------------------------------------------------------------------
+
+PDFWriter::PDFWriter( float p_page_width, float p_page_height, const Vec2f & user_min, float scale )
+{
+   page_width       = p_page_width ;
+   page_height      = p_page_height ;
+   cur_fill_alpha   = 1.0f ;
+   cur_line_width   = -1.0f ;
+   cur_dash         = -1.0f ;
+   cur_stroke_color = Vec3f( -1.0, -1.0, -1.0 );
+   stroke_state_set = false ;
+
+   // user coordinates to page coordinates, round caps and joins
+   op( "q" );
+   num( scale ); num( 0.0f ); num( 0.0f ); num( scale );
+   num( -user_min[0]*scale ); num( -user_min[1]*scale ); op( "cm" );
+   op( "1 J 1 j" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::num( float v )
+{
+   content += pdf_number( v );
+   content += ' ' ;
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::op( const char * oper )
+{
+   content += oper ;
+   content += '\n' ;
+}
+// -----------------------------------------------------------------------------
+
+std::string PDFWriter::resourceName( std::map<std::string,std::string> & names,
+                                     const std::string & key, const char * prefix )
+{
+   auto it = names.find( key );
+   if ( it != names.end() )
+      return it->second ;
+   const std::string name = prefix + std::to_string( names.size() );
+   names[key] = name ;
+   return name ;
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::polygonPath( const std::vector<Vec2f> & pts, bool close )
+{
+   for( std::size_t i = 0 ; i < pts.size() ; i++ )
+   {
+      num( pts[i][0] ); num( pts[i][1] );
+      op( i == 0 ? "m" : "l" );
+   }
+   if ( close )
+      op( "h" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::circlePath( const Vec2f & c, float r )
+{
+   const float k = 0.5522847498f*r ; // control points distance for a quarter circle
+   const float x = c[0], y = c[1] ;
+
+   num( x+r ); num( y ); op( "m" );
+   num( x+r ); num( y+k ); num( x+k ); num( y+r ); num( x );   num( y+r ); op( "c" );
+   num( x-k ); num( y+r ); num( x-r ); num( y+k ); num( x-r ); num( y );   op( "c" );
+   num( x-r ); num( y-k ); num( x-k ); num( y-r ); num( x );   num( y-r ); op( "c" );
+   num( x+k ); num( y-r ); num( x+r ); num( y-k ); num( x+r ); num( y );   op( "c" );
+   op( "h" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::setFillAlpha( float opacity )
+{
+   if ( opacity == cur_fill_alpha )
+      return ;
+   const std::string name = resourceName( ext_gstates,
+          "<< /Type /ExtGState /ca " + pdf_number( opacity ) + " >>", "GS" );
+   content += "/" + name + " gs\n" ;
+   cur_fill_alpha = opacity ;
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::setStrokeStyle( float width, float dash_length, const Vec3f & color )
+{
+   if ( ! stroke_state_set || width != cur_line_width )
+   {
+      num( width ); op( "w" );
+      cur_line_width = width ;
+   }
+   if ( ! stroke_state_set || dash_length != cur_dash )
+   {
+      if ( dash_length > 0.0f )
+         content += "[" + pdf_number( dash_length ) + " " + pdf_number( dash_length ) + "] 0 d\n" ;
+      else
+         op( "[] 0 d" );
+      cur_dash = dash_length ;
+   }
+   if ( ! stroke_state_set || color[0] != cur_stroke_color[0] ||
+        color[1] != cur_stroke_color[1] || color[2] != cur_stroke_color[2] )
+   {
+      num( color[0] ); num( color[1] ); num( color[2] ); op( "RG" );
+      cur_stroke_color = color ;
+   }
+   stroke_state_set = true ;
+}
+// -----------------------------------------------------------------------------
+// paint a gradient inside the current clipping path (between 'q' and 'Q')
+
+void PDFWriter::paintGradient( const RadialGradient & g, const Vec2f & box_min,
+                               const Vec2f & box_size, float opacity )
+{
+   if ( box_size[0] == 0.0f || box_size[1] == 0.0f )
+      return ;
+
+   // gradient coordinates are box units
+   num( box_size[0] ); num( 0.0f ); num( 0.0f ); num( box_size[1] );
+   num( box_min[0] );  num( box_min[1] ); op( "cm" );
+
+   const float a0 = g.stop0[3]*opacity,
+               a1 = g.stop1[3]*opacity ;
+   std::string gs_name ;
+   if ( a0 == a1 )
+      gs_name = resourceName( ext_gstates, "<< /Type /ExtGState /ca " + pdf_number( a0 ) + " >>", "GS" );
+   else
+      gs_name = resourceName( masks, radial_shading( g, "DeviceGray", &a0, &a1, 1 ), "GM" );
+
+   const std::string sh_name = resourceName( shadings, radial_shading( g, "DeviceRGB",
+                                             (const float *) g.stop0, (const float *) g.stop1, 3 ), "Sh" );
+   content += "/" + gs_name + " gs /" + sh_name + " sh\n" ;
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity )
+{
+   if ( pts.size() < 2 )
+      return ;
+   setFillAlpha( opacity );
+   num( color[0] ); num( color[1] ); num( color[2] ); op( "rg" );
+   polygonPath( pts, true );
+   op( "f" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                     const Vec2f & box_min, const Vec2f & box_size, float opacity )
+{
+   if ( pts.size() < 2 )
+      return ;
+   op( "q" );
+   polygonPath( pts, true );
+   op( "W n" );
+   paintGradient( grad, box_min, box_size, opacity );
+   op( "Q" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                float dash_length, const Vec3f & color )
+{
+   if ( pts.empty() || width <= 0.0f )
+      return ;
+   setStrokeStyle( width, dash_length, color );
+   polygonPath( pts, closed );
+   op( "S" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity )
+{
+   setFillAlpha( opacity );
+   num( color[0] ); num( color[1] ); num( color[2] ); op( "rg" );
+   circlePath( center, radius );
+   op( "f" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad,
+                                    float opacity )
+{
+   op( "q" );
+   circlePath( center, radius );
+   op( "W n" );
+   paintGradient( grad, center-Vec2f( radius, radius ), Vec2f( 2.0f*radius, 2.0f*radius ), opacity );
+   op( "Q" );
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color )
+{
+   setStrokeStyle( width, 0.0f, color );
+   circlePath( center, radius );
+   op( "S" );
+}
+// -----------------------------------------------------------------------------
+
+std::string PDFWriter::encode() const
+{
+   // objects 1 to 4: catalog, pages, page, contents. Then resources.
+   std::vector<std::string> objs( 4 );
+   std::string gs_dict, sh_dict ;
+
+   for( const auto & e : ext_gstates )
+   {
+      objs.push_back( e.first );
+      gs_dict += "/" + e.second + " " + std::to_string( objs.size() ) + " 0 R " ;
+   }
+   for( const auto & e : masks )
+   {
+      // soft mask: a transparency group painting the opacities as gray levels
+      objs.push_back( pdf_stream( "/Type /XObject /Subtype /Form /BBox [-0.01 -0.01 1.01 1.01]"
+                                  " /Group << /S /Transparency /CS /DeviceGray >>"
+                                  " /Resources << /Shading << /S0 " + e.first + " >> >>", "/S0 sh\n" ) );
+      objs.push_back( "<< /Type /ExtGState /ca 1 /SMask << /Type /Mask /S /Luminosity /G " +
+                      std::to_string( objs.size() ) + " 0 R >> >>" );
+      gs_dict += "/" + e.second + " " + std::to_string( objs.size() ) + " 0 R " ;
+   }
+   for( const auto & e : shadings )
+   {
+      objs.push_back( e.first );
+      sh_dict += "/" + e.second + " " + std::to_string( objs.size() ) + " 0 R " ;
+   }
+
+   objs[0] = "<< /Type /Catalog /Pages 2 0 R >>" ;
+   objs[1] = "<< /Type /Pages /Kids [3 0 R] /Count 1 >>" ;
+   objs[2] = "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " + pdf_number( page_width ) + " " +
+             pdf_number( page_height ) + "] /Contents 4 0 R /Resources << /ExtGState << " + gs_dict +
+             ">> /Shading << " + sh_dict + ">> >> /Group << /S /Transparency /CS /DeviceRGB >> >>" ;
+   objs[3] = pdf_stream( "", content + "Q\n" );
+
+   // file: header, objects, cross-reference table and trailer
+   std::string file = "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n" ;
+   std::vector<std::size_t> offsets ;
+   for( std::size_t i = 0 ; i < objs.size() ; i++ )
+   {
+      offsets.push_back( file.size() );
+      file += std::to_string( i+1 ) + " 0 obj\n" + objs[i] + "\nendobj\n" ;
+   }
+   const std::size_t xref = file.size() ;
+   file += "xref\n0 " + std::to_string( objs.size()+1 ) + "\n0000000000 65535 f \n" ;
+   for( std::size_t off : offsets )
+   {
+      char buf[32] ;
+      std::snprintf( buf, sizeof(buf), "%010lu 00000 n \n", (unsigned long) off );
+      file += buf ;
+   }
+   file += "trailer\n<< /Size " + std::to_string( objs.size()+1 ) + " /Root 1 0 R >>\n"
+           "startxref\n" + std::to_string( xref ) + "\n%%EOF\n" ;
+
+   return file ;
+}
+// -----------------------------------------------------------------------------
+
+void PDFWriter::write( const std::string & path ) const
+{
+   const std::string file = encode() ;
+
+   std::FILE * f = std::fopen( path.c_str(), "wb" );
+   if ( f == nullptr )
+      throw std::runtime_error( "cannot create '" + path + "': " + std::strerror( errno ) );
+   const bool ok = std::fwrite( file.data(), 1, file.size(), f ) == file.size() ;
+   if ( std::fclose( f ) != 0 || ! ok )
+      throw std::runtime_error( "cannot write '" + path + "'" );
+}
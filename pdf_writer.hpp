@@ -0,0 +1,97 @@
+// *********************************************************************
+// **
+// ** File: pdf_writer.hpp
+// ** Declarations for a writer of single-page vector PDF files
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef PDF_WRITER_HPP
+#define PDF_WRITER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "vector_templates.hpp"
+#include "render_sink.hpp"
+
+// *****************************************************************************
+// class PDFWriter : public RenderSink
+// A render sink which builds the content stream of a single page PDF file, and
+// writes the file. Drawing calls use 'user' (projected) coordinates (y upwards),
+// mapped to the page by a scale and a translation. Transparency uses ExtGState resources (one for each
+// distinct opacity), gradients use radial shading dictionaries, and gradients
+// with varying opacity are painted through a luminosity soft mask (a transparency
+// group painting the opacities as a gray shading). The content stream and the
+// mask groups are Flate-compressed.
+
+class PDFWriter : public RenderSink
+{
+   public:
+
+   // page size in points, and mapping from user coordinates to the page:
+   // page = (user-user_min)*scale
+   PDFWriter( float p_page_width, float p_page_height, const Vec2f & user_min, float scale ) ;
+
+   // fill a polygon (non-zero rule) with a solid color
+   virtual void fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity ) ;
+
+   // fill a polygon with a radial gradient (in units of the box with lower-left
+   // corner 'box_min' and size 'box_size', in user coordinates)
+   virtual void fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                     const Vec2f & box_min, const Vec2f & box_size, float opacity ) ;
+
+   // stroke a polyline (round caps and joins), dashed when 'dash_length' > 0
+   virtual void strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                float dash_length, const Vec3f & color ) ;
+
+   // fill and stroke circles (drawn as four Bézier arcs)
+   virtual void fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity ) ;
+   virtual void fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad, float opacity ) ;
+   virtual void strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color ) ;
+
+   // write the PDF file (throws std::runtime_error if it cannot be written)
+   void write( const std::string & path ) const ;
+
+   // the contents of the PDF file, in memory
+   std::string encode() const ;
+
+   private:
+
+   void num( float v ) ;                       // append a number to the content stream
+   void op( const char * oper ) ;              // append an operator (and a new line)
+   void polygonPath( const std::vector<Vec2f> & pts, bool close ) ;
+   void circlePath( const Vec2f & center, float radius ) ;
+   void setFillAlpha( float opacity ) ;
+   void setStrokeStyle( float width, float dash_length, const Vec3f & color ) ;
+   void paintGradient( const RadialGradient & grad, const Vec2f & box_min,
+                       const Vec2f & box_size, float opacity ) ;
+   std::string resourceName( std::map<std::string,std::string> & names,
+                             const std::string & key, const char * prefix ) ;
+
+   float        page_width, page_height ;
+   std::string  content ;   // uncompressed page content stream
+
+   // resources: key (the object dictionary or stream) --> name in the page resources
+   std::map<std::string,std::string> ext_gstates, shadings, masks ;
+
+   // current graphic state, to avoid repeating operators
+   float        cur_fill_alpha, cur_line_width, cur_dash ;
+   Vec3f        cur_stroke_color ;
+   bool         stroke_state_set ;
+} ;
+
+#endif
@@ -0,0 +1,40 @@
+// *********************************************************************
+// **
+// ** File: radial_gradient.hpp
+// ** Parameters of radial gradients shared by the output backends
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef RADIAL_GRADIENT_HPP
+#define RADIAL_GRADIENT_HPP
+
+#include "vector_templates.hpp"
+
+// *****************************************************************************
+// class RadialGradient
+// parameters of a two-stops radial gradient, in units of the bounding box of
+// the painted shape (as SVG 'objectBoundingBox' gradients): center (cx,cy),
+// radius r and focal point (fx,fy). Stops are (r,g,b,opacity) at offsets 0 and 1.
+
+class RadialGradient
+{
+   public:
+   float cx, cy, r, fx, fy ;
+   Vec4f stop0, stop1 ;
+} ;
+
+#endif
@@ -0,0 +1,661 @@
+// *********************************************************************
+// **
+// ** File: raster.cpp
+// ** Implementation of an anti-aliased tiled rasterizer with PNG output
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "raster.hpp"
+#include "parallel.hpp"
+
+// Aux functions
+
+// -----------------------------------------------------------------------------
+// accumulate the signed area contributions of a line (with 0 <= x <= tile width)
+// into the rows of 'acc'. After a prefix sum along a row, the absolute value of
+// each sum is the coverage of that pixel (non-zero winding rule, exact area).
+
+static void accumulate_span( float * acc, unsigned stride, unsigned th,
+                             float x0, float y0, float x1, float y1 )
+{
+   if ( y0 == y1 )
+      return ;
+
+   float dir = 1.0f ;
+   if ( y1 < y0 )
+   {
+      std::swap( x0, x1 );
+      std::swap( y0, y1 );
+      dir = -1.0f ;
+   }
+   if ( y1 <= 0.0f || float(th) <= y0 )
+      return ;
+
+   const float dxdy   = (x1-x0)/(y1-y0) ;
+   const int   ystart = std::max( 0, int( std::floor( y0 ) ) ),
+               yend   = std::min( int(th), int( std::ceil( y1 ) ) );
+
+   for( int y = ystart ; y < yend ; y++ )
+   {
+      const float ya = std::max( float(y), y0 ),
+                  yb = std::min( float(y+1), y1 ),
+                  d  = (yb-ya)*dir ;
+      if ( ! ( ya < yb ) )
+         continue ;
+
+      const float xa  = x0 + (ya-y0)*dxdy,
+                  xb  = x0 + (yb-y0)*dxdy,
+                  xl  = std::max( 0.0f, std::min( xa, xb ) ),
+                  xr  = std::max( xl,   std::max( xa, xb ) ),
+                  xlf = std::floor( xl ),
+                  xrc = std::ceil( xr );
+      const int   xli = int( xlf ),
+                  xri = int( xrc );
+      float *     row = acc + std::size_t(y)*stride ;
+
+      if ( xri <= xli+1 ) // the line is inside a single pixel of this row
+      {
+         const float xmf = 0.5f*(xl+xr) - xlf ;
+         row[xli]   += d - d*xmf ;
+         row[xli+1] += d*xmf ;
+      }
+      else // the line crosses several pixels: trapezoids, constant area in the middle
+      {
+         const float s      = 1.0f/(xr-xl),
+                     xlfrac = xl - xlf,
+                     a0     = 0.5f*s*(1.0f-xlfrac)*(1.0f-xlfrac),
+                     xrfrac = xr - xrc + 1.0f,
+                     am     = 0.5f*s*xrfrac*xrfrac ;
+
+         row[xli] += d*a0 ;
+         if ( xri == xli+2 )
+            row[xli+1] += d*(1.0f-a0-am);
+         else
+         {
+            const float a1 = s*(1.5f-xlfrac);
+            row[xli+1] += d*(a1-a0);
+            for( int xi = xli+2 ; xi < xri-1 ; xi++ )
+               row[xi] += d*s ;
+            const float a2 = a1 + float(xri-xli-3)*s ;
+            row[xri-1] += d*(1.0f-a2-am);
+         }
+         row[xri] += d*am ;
+      }
+   }
+}
+// -----------------------------------------------------------------------------
+// accumulate a line with any x: the line is split where it crosses x=0 and x=tw,
+// parts at the left become vertical lines at x=0 (they cover the whole row),
+// parts at the right are dropped (they do not change the pixels in the tile)
+
+static void accumulate_line( float * acc, unsigned stride, unsigned tw, unsigned th,
+                             const Vec2f & p0, const Vec2f & p1 )
+{
+   const float x0 = p0[0], y0 = p0[1],
+               x1 = p1[0], y1 = p1[1],
+               xw = float(tw) ;
+
+   if ( y0 == y1 || ( xw <= x0 && xw <= x1 ) )
+      return ;
+
+   float ts[4] ;
+   unsigned nt = 0 ;
+   ts[nt++] = 0.0f ;
+   if ( (x0 < 0.0f) != (x1 < 0.0f) )
+      ts[nt++] = (0.0f-x0)/(x1-x0) ;
+   if ( (x0 < xw) != (x1 < xw) )
+      ts[nt++] = (xw-x0)/(x1-x0) ;
+   std::sort( ts+1, ts+nt );
+   ts[nt++] = 1.0f ;
+
+   for( unsigned i = 0 ; i+1 < nt ; i++ )
+   {
+      const float xa = x0 + ts[i]*(x1-x0),   ya = y0 + ts[i]*(y1-y0),
+                  xb = x0 + ts[i+1]*(x1-x0), yb = y0 + ts[i+1]*(y1-y0),
+                  xm = 0.5f*(xa+xb) ;
+      if ( xw <= xm )
+         continue ;
+      if ( xm <= 0.0f )
+         accumulate_span( acc, stride, th, 0.0f, ya, 0.0f, yb );
+      else
+         accumulate_span( acc, stride, th, std::min( std::max( xa, 0.0f ), xw ), ya,
+                                           std::min( std::max( xb, 0.0f ), xw ), yb );
+   }
+}
+// -----------------------------------------------------------------------------
+// prefix sum of a row of accumulated areas, giving coverages in [0,1]
+// (n must be a multiple of 4)
+
+static void coverage_row( const float * acc, float * cov, unsigned n )
+{
+#if defined(__SSE2__)
+   const __m128 sign = _mm_set1_ps( -0.0f ),
+                one  = _mm_set1_ps( 1.0f );
+   __m128 sum = _mm_setzero_ps() ;
+
+   for( unsigned i = 0 ; i < n ; i += 4 )
+   {
+      // in-register prefix sum of 4 values (two shifted adds), plus the running sum
+      __m128 v = _mm_loadu_ps( acc+i );
+      v   = _mm_add_ps( v, _mm_castsi128_ps( _mm_slli_si128( _mm_castps_si128( v ), 4 ) ) );
+      v   = _mm_add_ps( v, _mm_castsi128_ps( _mm_slli_si128( _mm_castps_si128( v ), 8 ) ) );
+      v   = _mm_add_ps( v, sum );
+      sum = _mm_shuffle_ps( v, v, _MM_SHUFFLE(3,3,3,3) );
+      _mm_storeu_ps( cov+i, _mm_min_ps( _mm_andnot_ps( sign, v ), one ) );
+   }
+#else
+   float sum = 0.0f ;
+   for( unsigned i = 0 ; i < n ; i++ )
+   {
+      sum += acc[i] ;
+      cov[i] = std::min( std::fabs( sum ), 1.0f );
+   }
+#endif
+}
+// -----------------------------------------------------------------------------
+// color (r,g,b,opacity) of a gradient paint at pixel (px,py)
+
+static Vec4f gradient_color( const RasterPaint & paint, float px, float py )
+{
+   const RadialGradient & g = paint.gradient ;
+
+   // position in bounding box units, relative to the focal point and the center
+   const float u  = (px-paint.box_org[0])/paint.box_size[0],
+               v  = (py-paint.box_org[1])/paint.box_size[1],
+               dx = u-g.fx, dy = v-g.fy,
+               ex = g.fx-g.cx, ey = g.fy-g.cy,
+               len = std::sqrt( dx*dx + dy*dy );
+
+   // t = distance to the focal point, relative to the distance from the
+   // focal point to the circle along the same ray
+   float t = 0.0f ;
+   if ( len > 1e-9f )
+   {
+      const float b    = (dx*ex + dy*ey)/len,
+                  c    = ex*ex + ey*ey - g.r*g.r,
+                  disc = std::max( 0.0f, b*b - c ),
+                  lam  = -b + std::sqrt( disc );
+      t = lam > 0.0f ? std::min( 1.0f, len/lam ) : 1.0f ;
+   }
+   return Vec4f( g.stop0 + t*(g.stop1-g.stop0) );
+}
+
+// -----------------------------------------------------------------------------
+
+static void write_be32( std::vector<unsigned char> & buf, unsigned long v )
+{
+   buf.push_back( (v >> 24) & 0xff );
+   buf.push_back( (v >> 16) & 0xff );
+   buf.push_back( (v >>  8) & 0xff );
+   buf.push_back(  v        & 0xff );
+}
+// -----------------------------------------------------------------------------
+
+static void append_png_chunk( std::string & png, const char * type,
+                             const std::vector<unsigned char> & data )
+{
+   std::vector<unsigned char> head ;
+   write_be32( head, data.size() );
+   head.insert( head.end(), type, type+4 );
+
+   uLong crc = crc32( 0L, Z_NULL, 0 );
+   crc = crc32( crc, reinterpret_cast<const Bytef *>( type ), 4 );
+   if ( ! data.empty() )
+      crc = crc32( crc, data.data(), uInt( data.size() ) );
+   std::vector<unsigned char> tail ;
+   write_be32( tail, crc );
+
+   png.append( head.begin(), head.end() );
+   png.append( data.begin(), data.end() );
+   png.append( tail.begin(), tail.end() );
+}
+
+// *****************************************************************************
+// class RasterPaint
+// -----------------------------------------------------------------------------
+
+RasterPaint RasterPaint::solid( const Vec3f & color, float opacity )
+{
+   RasterPaint p ;
+   p.use_gradient = false ;
+   p.color        = color ;
+   p.opacity      = opacity ;
+   return p ;
+}
+// -----------------------------------------------------------------------------
+
+RasterPaint RasterPaint::radial( const RadialGradient & grad, const Vec2f & box_org,
+                                 const Vec2f & box_size, float opacity )
+{
+   RasterPaint p ;
+   p.use_gradient = true ;
+   p.color        = Vec3f( 0.0, 0.0, 0.0 );
+   p.opacity      = opacity ;
+   p.gradient     = grad ;
+   p.box_org      = box_org ;
+   p.box_size     = box_size ;
+   return p ;
+}
+
+// *****************************************************************************
+// class RasterCanvas
+// -----------------------------------------------------------------------------
+
+constexpr unsigned RasterCanvas::tile_size ;
+
+RasterCanvas::RasterCanvas( unsigned p_width, unsigned p_height )
+{
+   assert( 0 < p_width && 0 < p_height );
+   w = p_width ;
+   h = p_height ;
+   pixels.assign( std::size_t(w)*h*4, 0.0f );
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::addContour( Shape & shape, const Vec2f * pts, unsigned n, bool positive )
+{
+   if ( n < 3 )
+      return ;
+
+   // stroke pieces must all have the same orientation, so overlaps add up
+   bool reverse = false ;
+   if ( positive )
+   {
+      float area2 = 0.0f ;
+      for( unsigned i = 0 ; i < n ; i++ )
+      {
+         const Vec2f & a = pts[i], & b = pts[(i+1)%n] ;
+         area2 += a[0]*b[1] - b[0]*a[1] ;
+      }
+      reverse = area2 < 0.0f ;
+   }
+   for( unsigned i = 0 ; i < n ; i++ )
+      shape.pts.push_back( pts[ reverse ? n-1-i : i ] );
+   shape.contour_ends.push_back( shape.pts.size() );
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::addShape( Shape & shape )
+{
+   if ( shape.pts.empty() )
+      return ;
+
+   shape.xmin = shape.xmax = shape.pts[0][0] ;
+   shape.ymin = shape.ymax = shape.pts[0][1] ;
+   for( const Vec2f & p : shape.pts )
+   {
+      shape.xmin = std::min( shape.xmin, p[0] );
+      shape.xmax = std::max( shape.xmax, p[0] );
+      shape.ymin = std::min( shape.ymin, p[1] );
+      shape.ymax = std::max( shape.ymax, p[1] );
+   }
+   // NaN coordinates would poison all the tiles the shape touches
+   if ( ! ( shape.xmin <= shape.xmax && shape.ymin <= shape.ymax ) )
+      return ;
+   shapes.push_back( std::move( shape ) );
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::fillPolygon( const std::vector<Vec2f> & pts, const RasterPaint & paint )
+{
+   Shape shape ;
+   shape.paint = paint ;
+   addContour( shape, pts.data(), pts.size(), false );
+   addShape( shape );
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::fillCircle( const Vec2f & center, float radius, const RasterPaint & paint )
+{
+   fillPolygon( circlePolygon( center, radius ), paint );
+}
+// -----------------------------------------------------------------------------
+
+std::vector<Vec2f> RasterCanvas::circlePolygon( const Vec2f & center, float radius )
+{
+   // about one vertex each two pixels of perimeter (chord error < 0.01 pixels)
+   const unsigned n = std::max( 12u, std::min( 2048u, unsigned( std::ceil( M_PI*radius ) ) ) );
+   std::vector<Vec2f> pts( n );
+   for( unsigned i = 0 ; i < n ; i++ )
+   {
+      const double ang = 2.0*M_PI*double(i)/double(n) ;
+      pts[i] = Vec2f( center[0] + radius*float(std::cos(ang)), center[1] + radius*float(std::sin(ang)) );
+   }
+   return pts ;
+}
+// -----------------------------------------------------------------------------
+// add to 'shape' the stroke of an open polyline: a quad for each segment and a
+// disk at each vertex (round joins and caps), all with the same orientation
+
+void RasterCanvas::strokeRun( Shape & shape, const std::vector<Vec2f> & pts, float half_width )
+{
+   for( std::size_t i = 0 ; i < pts.size() ; i++ )
+   {
+      const std::vector<Vec2f> disk = circlePolygon( pts[i], half_width );
+      addContour( shape, disk.data(), disk.size(), true );
+
+      if ( i+1 == pts.size() )
+         break ;
+      const Vec2f d   = pts[i+1]-pts[i] ;
+      const float len = std::sqrt( d[0]*d[0] + d[1]*d[1] );
+      if ( len <= 1e-6f )
+         continue ;
+      const Vec2f n = Vec2f( -d[1], d[0] )*(half_width/len) ;
+      const Vec2f quad[4] = { pts[i]+n, pts[i+1]+n, pts[i+1]-n, pts[i]-n } ;
+      addContour( shape, quad, 4, true );
+   }
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::strokePolyline( const std::vector<Vec2f> & p_pts, bool closed, float width,
+                                   float dash_length, const RasterPaint & paint )
+{
+   if ( p_pts.empty() || width <= 0.0f )
+      return ;
+
+   std::vector<Vec2f> pts = p_pts ;
+   if ( closed && 1 < pts.size() )
+      pts.push_back( pts[0] );
+
+   Shape shape ;
+   shape.paint = paint ;
+   const float hw = 0.5f*width ;
+
+   if ( dash_length <= 0.0f )
+      strokeRun( shape, pts, hw );
+   else
+   {
+      // walk the polyline, alternating dashes and gaps of length 'dash_length'
+      std::vector<Vec2f> dash ;
+      bool  on        = true ;
+      float remaining = dash_length ;
+      dash.push_back( pts[0] );
+
+      for( std::size_t i = 0 ; i+1 < pts.size() ; i++ )
+      {
+         Vec2f       a   = pts[i] ;
+         const Vec2f b   = pts[i+1] ;
+         float       len = std::sqrt( (b-a)[0]*(b-a)[0] + (b-a)[1]*(b-a)[1] );
+
+         while ( remaining < len )
+         {
+            const Vec2f m = a + (b-a)*(remaining/len) ;
+            if ( on )
+            {
+               dash.push_back( m );
+               strokeRun( shape, dash, hw );
+               dash.clear();
+            }
+            else
+               dash.push_back( m );
+            on        = ! on ;
+            len      -= remaining ;
+            a         = m ;
+            remaining = dash_length ;
+         }
+         remaining -= len ;
+         if ( on )
+            dash.push_back( b );
+      }
+      if ( on && 1 < dash.size() )
+         strokeRun( shape, dash, hw );
+   }
+   addShape( shape );
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::renderTile( unsigned tx, unsigned ty, const std::vector<unsigned> & shape_indexes,
+                               std::vector<float> & acc, std::vector<float> & cov )
+{
+   const unsigned ox = tx*tile_size, oy = ty*tile_size,
+                  tw = std::min( tile_size, w-ox ),
+                  th = std::min( tile_size, h-oy ),
+                  stride = tile_size+4 ;
+   const Vec2f    org = Vec2f( float(ox), float(oy) );
+
+   acc.assign( std::size_t(stride)*tile_size, 0.0f );
+   cov.resize( tile_size );
+
+   for( unsigned is : shape_indexes )
+   {
+      const Shape & shape = shapes[is] ;
+      const int r0 = std::max( 0, int( std::floor( shape.ymin ) ) - int(oy) ),
+                r1 = std::min( int(th), int( std::ceil( shape.ymax ) ) - int(oy) + 1 ),
+                c0 = std::max( 0, int( std::floor( shape.xmin ) ) - int(ox) ),
+                c1 = std::min( int(tw), int( std::ceil( shape.xmax ) ) - int(ox) + 1 );
+      if ( r1 <= r0 || c1 <= c0 )
+         continue ;
+
+      // accumulate the areas of the contour edges
+      unsigned first = 0 ;
+      for( unsigned end : shape.contour_ends )
+      {
+         for( unsigned i = first ; i < end ; i++ )
+         {
+            const unsigned j = ( i+1 < end ) ? i+1 : first ;
+            accumulate_line( acc.data(), stride, tw, th, shape.pts[i]-org, shape.pts[j]-org );
+         }
+         first = end ;
+      }
+
+      // coverage and compositing, row by row (clearing the accumulators)
+      const RasterPaint & paint = shape.paint ;
+      for( int r = r0 ; r < r1 ; r++ )
+      {
+         float * arow = acc.data() + std::size_t(r)*stride ;
+         coverage_row( arow, cov.data(), tile_size );
+         std::fill( arow, arow+stride, 0.0f );
+
+         float * dst = pixels.data() + ( std::size_t(oy+r)*w + ox )*4 ;
+         for( int c = c0 ; c < c1 ; c++ )
+         {
+            if ( cov[c] <= 0.0f )
+               continue ;
+            Vec4f col ;
+            if ( paint.use_gradient )
+               col = gradient_color( paint, float(ox+c)+0.5f, float(oy+r)+0.5f );
+            else
+               col = Vec4f( paint.color[0], paint.color[1], paint.color[2], 1.0f );
+
+            const float a = cov[c]*col[3]*paint.opacity,
+                        k = 1.0f-a ;
+            float * px = dst + 4*c ;
+            px[0] = col[0]*a + px[0]*k ;
+            px[1] = col[1]*a + px[1]*k ;
+            px[2] = col[2]*a + px[2]*k ;
+            px[3] = a        + px[3]*k ;
+         }
+      }
+   }
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::render()
+{
+   const unsigned ntx = (w+tile_size-1)/tile_size,
+                  nty = (h+tile_size-1)/tile_size ;
+
+   // bin shapes into the tiles their bounding boxes overlap (keeping drawing order)
+   std::vector< std::vector<unsigned> > bins( ntx*nty );
+   for( unsigned is = 0 ; is < shapes.size() ; is++ )
+   {
+      const Shape & s = shapes[is] ;
+      if ( s.xmax < 0.0f || s.ymax < 0.0f || float(w) <= s.xmin || float(h) <= s.ymin )
+         continue ;
+      const unsigned tx0 = unsigned( std::max( 0.0f, s.xmin ) )/tile_size,
+                     ty0 = unsigned( std::max( 0.0f, s.ymin ) )/tile_size,
+                     tx1 = std::min( ntx-1, unsigned( s.xmax )/tile_size ),
+                     ty1 = std::min( nty-1, unsigned( s.ymax )/tile_size );
+      for( unsigned ty = ty0 ; ty <= ty1 ; ty++ )
+         for( unsigned tx = tx0 ; tx <= tx1 ; tx++ )
+            bins[ty*ntx+tx].push_back( is );
+   }
+
+   // render tiles in parallel, interleaved among the threads for load balance
+   const std::size_t ntiles = bins.size(),
+                     nc     = parallel_num_chunks( ntiles, 1 );
+
+   parallel_for_chunks( ntiles, 1,
+     [&]( std::size_t ic, std::size_t, std::size_t )
+     {
+        std::vector<float> acc, cov ;
+        for( std::size_t it = ic ; it < ntiles ; it += nc )
+           if ( ! bins[it].empty() )
+              renderTile( it % ntx, it / ntx, bins[it], acc, cov );
+     });
+
+   shapes.clear();
+}
+// -----------------------------------------------------------------------------
+
+std::string RasterCanvas::encodePNG() const
+{
+   // raw image: a filter byte (0, none) then non-premultiplied RGBA for each row
+   std::vector<unsigned char> raw( std::size_t(h)*(1+4*std::size_t(w)) );
+   unsigned char * q = raw.data() ;
+   for( unsigned y = 0 ; y < h ; y++ )
+   {
+      *q++ = 0 ;
+      const float * px = pixels.data() + std::size_t(y)*w*4 ;
+      for( unsigned x = 0 ; x < w ; x++, px += 4 )
+      {
+         const float a = std::min( 1.0f, std::max( 0.0f, px[3] ) ),
+                     f = a > 0.0f ? 1.0f/a : 0.0f ;
+         for( unsigned k = 0 ; k < 3 ; k++ )
+            *q++ = (unsigned char)( std::min( 1.0f, std::max( 0.0f, px[k]*f ) )*255.0f + 0.5f );
+         *q++ = (unsigned char)( a*255.0f + 0.5f );
+      }
+   }
+
+   uLongf zlen = compressBound( raw.size() );
+   std::vector<unsigned char> idat( zlen );
+   if ( compress2( idat.data(), &zlen, raw.data(), raw.size(), 6 ) != Z_OK )
+      throw std::runtime_error( "cannot compress PNG image data" );
+   idat.resize( zlen );
+
+   std::vector<unsigned char> ihdr ;
+   write_be32( ihdr, w );
+   write_be32( ihdr, h );
+   const unsigned char ihdr_rest[5] = { 8, 6, 0, 0, 0 } ; // 8 bits, RGBA, deflate, no filter, no interlace
+   ihdr.insert( ihdr.end(), ihdr_rest, ihdr_rest+5 );
+
+   const char signature[8] = { char(0x89), 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' } ;
+   std::string png( signature, 8 );
+   append_png_chunk( png, "IHDR", ihdr );
+   append_png_chunk( png, "IDAT", idat );
+   append_png_chunk( png, "IEND", std::vector<unsigned char>() );
+   return png ;
+}
+// -----------------------------------------------------------------------------
+
+void RasterCanvas::writePNG( const std::string & path ) const
+{
+   const std::string png = encodePNG() ;
+
+   std::FILE * f = std::fopen( path.c_str(), "wb" );
+   if ( f == nullptr )
+      throw std::runtime_error( "cannot create '" + path + "': " + std::strerror( errno ) );
+   const bool ok = std::fwrite( png.data(), 1, png.size(), f ) == png.size() ;
+   if ( std::fclose( f ) != 0 || ! ok )
+      throw std::runtime_error( "cannot write '" + path + "'" );
+}
+
+// *****************************************************************************
+// class RasterSink
+// -----------------------------------------------------------------------------
+
+RasterSink::RasterSink( RasterCanvas & p_canvas, const Vec2f & p_box_min, const Vec2f & p_box_w, float p_scale )
+
+: canvas( p_canvas )
+{
+   box_min = p_box_min ;
+   box_w   = p_box_w ;
+   scale   = p_scale ;
+}
+// -----------------------------------------------------------------------------
+
+Vec2f RasterSink::pixel( const Vec2f & p ) const
+{
+   return Vec2f( (p[0]-box_min[0])*scale, (box_min[1]+box_w[1]-p[1])*scale );
+}
+// -----------------------------------------------------------------------------
+
+std::vector<Vec2f> RasterSink::pixels( const std::vector<Vec2f> & pts ) const
+{
+   std::vector<Vec2f> res( pts.size() );
+   for( std::size_t i = 0 ; i < pts.size() ; i++ )
+      res[i] = pixel( pts[i] );
+   return res ;
+}
+// -----------------------------------------------------------------------------
+
+void RasterSink::fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity )
+{
+   canvas.fillPolygon( pixels( pts ), RasterPaint::solid( color, opacity ) );
+}
+// -----------------------------------------------------------------------------
+
+void RasterSink::fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                      const Vec2f & p_box_min, const Vec2f & box_size, float opacity )
+{
+   // the box is flipped, as the y axis points downwards in the canvas
+   canvas.fillPolygon( pixels( pts ), RasterPaint::radial( grad, pixel( p_box_min ),
+                       Vec2f( box_size[0]*scale, -box_size[1]*scale ), opacity ) );
+}
+// -----------------------------------------------------------------------------
+
+void RasterSink::strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                 float dash_length, const Vec3f & color )
+{
+   canvas.strokePolyline( pixels( pts ), closed, width*scale, dash_length*scale,
+                          RasterPaint::solid( color, 1.0 ) );
+}
+// -----------------------------------------------------------------------------
+
+void RasterSink::fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity )
+{
+   canvas.fillCircle( pixel( center ), radius*scale, RasterPaint::solid( color, opacity ) );
+}
+// -----------------------------------------------------------------------------
+
+void RasterSink::fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad,
+                                     float opacity )
+{
+   const Vec2f box_org  = pixel( center-Vec2f( radius, radius ) );
+   const float box_size = 2.0f*radius*scale ;
+   canvas.fillCircle( pixel( center ), radius*scale,
+                      RasterPaint::radial( grad, box_org, Vec2f( box_size, -box_size ), opacity ) );
+}
+// -----------------------------------------------------------------------------
+
+void RasterSink::strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color )
+{
+   canvas.strokePolyline( RasterCanvas::circlePolygon( pixel( center ), radius*scale ), true,
+                          width*scale, 0.0f, RasterPaint::solid( color, 1.0 ) );
+}
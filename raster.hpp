@@ -0,0 +1,145 @@
+// *********************************************************************
+// **
+// ** File: raster.hpp
+// ** Declarations for an anti-aliased tiled rasterizer with PNG output
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef RASTER_HPP
+#define RASTER_HPP
+
+#include <string>
+#include <vector>
+#include "vector_templates.hpp"
+#include "render_sink.hpp"
+
+// *****************************************************************************
+// class RasterPaint
+// how a shape is painted: a solid color or a radial gradient, and an opacity.
+// For gradients, the bounding box maps pixel (px,py) to box units
+// ( (px-box_org[0])/box_size[0], (py-box_org[1])/box_size[1] ) (sizes may be negative)
+
+class RasterPaint
+{
+   public:
+   static RasterPaint solid( const Vec3f & color, float opacity ) ;
+   static RasterPaint radial( const RadialGradient & grad, const Vec2f & box_org,
+                              const Vec2f & box_size, float opacity ) ;
+
+   bool           use_gradient ;
+   Vec3f          color ;
+   float          opacity ;
+   RadialGradient gradient ;
+   Vec2f          box_org, box_size ;
+} ;
+
+// *****************************************************************************
+// class RasterCanvas
+// An RGBA image. Drawing calls (in pixel coordinates, y downwards) are recorded
+// in a display list, and 'render' rasterizes it: the image is split in square
+// tiles which are rendered in parallel. Each shape is filled with the non-zero
+// rule and exact area coverage (computed with SIMD prefix sums when available),
+// and composited in drawing order ('source over', premultiplied alpha).
+
+class RasterCanvas
+{
+   public:
+   RasterCanvas( unsigned p_width, unsigned p_height ) ;
+
+   // fill a polygon (implicitly closed)
+   void fillPolygon( const std::vector<Vec2f> & pts, const RasterPaint & paint ) ;
+
+   // stroke a polyline with round caps and joins. When 'dash_length' is greater
+   // than zero, dashes and gaps of that length alternate along the polyline
+   void strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                        float dash_length, const RasterPaint & paint ) ;
+
+   // fill a circle
+   void fillCircle( const Vec2f & center, float radius, const RasterPaint & paint ) ;
+
+   // vertexes of a polygon approximating a circle (to within a small fraction of a pixel)
+   static std::vector<Vec2f> circlePolygon( const Vec2f & center, float radius ) ;
+
+   // rasterize all the shapes drawn so far (then the display list is cleared)
+   void render() ;
+
+   // write the rendered image to a PNG file (8 bits RGBA, non-premultiplied)
+   // (throws std::runtime_error when the file cannot be written)
+   void writePNG( const std::string & path ) const ;
+
+   // the contents of the PNG file, in memory
+   std::string encodePNG() const ;
+
+   unsigned width() const  { return w ; }
+   unsigned height() const { return h ; }
+
+   static constexpr unsigned tile_size = 64 ; // tiles are tile_size x tile_size pixels
+
+   private:
+
+   // a recorded shape: closed contours (consecutive runs of 'pts') and its paint
+   class Shape
+   {
+      public:
+      std::vector<Vec2f>    pts ;
+      std::vector<unsigned> contour_ends ; // end index of each contour in 'pts'
+      RasterPaint           paint ;
+      float                 xmin, ymin, xmax, ymax ; // bounding box, in pixels
+   } ;
+
+   void addContour( Shape & shape, const Vec2f * pts, unsigned n, bool positive ) ;
+   void addShape( Shape & shape ) ;
+   void strokeRun( Shape & shape, const std::vector<Vec2f> & pts, float half_width ) ;
+   void renderTile( unsigned tx, unsigned ty, const std::vector<unsigned> & shape_indexes,
+                    std::vector<float> & acc, std::vector<float> & cov ) ;
+
+   unsigned            w, h ;
+   std::vector<float>  pixels ;     // premultiplied RGBA, row by row
+   std::vector<Shape>  shapes ;     // display list
+} ;
+
+// *****************************************************************************
+// class RasterSink
+// A render sink which draws on a canvas: maps projected coordinates (y upwards)
+// in the region with lower-left corner 'box_min' and size 'box_w' to canvas
+// pixels (y downwards), with 'scale' pixels per projected unit.
+
+class RasterSink : public RenderSink
+{
+   public:
+   RasterSink( RasterCanvas & p_canvas, const Vec2f & p_box_min, const Vec2f & p_box_w, float p_scale ) ;
+
+   virtual void fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity ) ;
+   virtual void fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                     const Vec2f & box_min, const Vec2f & box_size, float opacity ) ;
+   virtual void strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                float dash_length, const Vec3f & color ) ;
+   virtual void fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity ) ;
+   virtual void fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad,
+                                    float opacity ) ;
+   virtual void strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color ) ;
+
+   private:
+   Vec2f pixel( const Vec2f & p ) const ;             // pixel position of a projected point
+   std::vector<Vec2f> pixels( const std::vector<Vec2f> & pts ) const ;
+
+   RasterCanvas & canvas ;
+   Vec2f          box_min, box_w ;
+   float          scale ;
+} ;
+
+#endif
@@ -0,0 +1,407 @@
+// *********************************************************************
+// **
+// ** File: render_daemon.cpp
+// ** Implementation of a render server on a Unix domain socket
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "render_daemon.hpp"
+#include "figures.hpp"
+
+// Aux functions
+
+// -----------------------------------------------------------------------------
+
+static double seconds_now()
+{
+   using namespace std::chrono ;
+   return duration<double>( steady_clock::now().time_since_epoch() ).count() ;
+}
+// -----------------------------------------------------------------------------
+// send all the bytes (false when the peer has gone away)
+
+static bool send_all( int fd, const char * data, std::size_t n )
+{
+   while ( n > 0 )
+   {
+      const ssize_t k = ::send( fd, data, n, MSG_NOSIGNAL );
+      if ( k < 0 && errno == EINTR )
+         continue ;
+      if ( k <= 0 )
+         return false ;
+      data += k ;
+      n    -= std::size_t( k );
+   }
+   return true ;
+}
+// -----------------------------------------------------------------------------
+
+static constexpr int poll_ms = 200 ; // how often blocked threads check for 'stop'
+static constexpr std::size_t max_request_length = 4096 ;
+static constexpr std::size_t num_recent_latencies = 1024 ;
+
+// *****************************************************************************
+// class RenderDaemon
+// -----------------------------------------------------------------------------
+
+RenderDaemon::RenderDaemon( const std::string & p_socket_path, unsigned p_num_workers )
+{
+   socket_path     = p_socket_path ;
+   num_workers     = std::max( 1u, p_num_workers );
+   stopping        = false ;
+   requests        = 0 ;
+   errors          = 0 ;
+   busy_workers    = 0 ;
+   max_queue_depth = 0 ;
+   latency_sum     = 0.0 ;
+   latency_max     = 0.0 ;
+   recent_next     = 0 ;
+
+   sockaddr_un addr ;
+   std::memset( &addr, 0, sizeof(addr) );
+   addr.sun_family = AF_UNIX ;
+   if ( socket_path.size() >= sizeof(addr.sun_path) )
+      throw std::runtime_error( "socket path too long: '" + socket_path + "'" );
+   std::strcpy( addr.sun_path, socket_path.c_str() );
+
+   listen_fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+   if ( listen_fd < 0 )
+      throw std::runtime_error( std::string( "cannot create socket: " ) + std::strerror( errno ) );
+
+   ::unlink( socket_path.c_str() );
+   if ( ::bind( listen_fd, reinterpret_cast<sockaddr *>( &addr ), sizeof(addr) ) != 0 ||
+        ::listen( listen_fd, 64 ) != 0 )
+   {
+      const std::string msg = "cannot listen on '" + socket_path + "': " + std::strerror( errno ) ;
+      ::close( listen_fd );
+      throw std::runtime_error( msg );
+   }
+}
+// -----------------------------------------------------------------------------
+
+RenderDaemon::~RenderDaemon()
+{
+   stop();
+   for( std::thread & t : workers )
+      if ( t.joinable() )
+         t.join();
+   for( int fd : pending )
+      ::close( fd );
+   ::close( listen_fd );
+   ::unlink( socket_path.c_str() );
+}
+// -----------------------------------------------------------------------------
+
+void RenderDaemon::stop()
+{
+   {
+      std::lock_guard<std::mutex> lock( mtx );
+      stopping = true ;
+   }
+   cond.notify_all();
+}
+// -----------------------------------------------------------------------------
+
+void RenderDaemon::run()
+{
+   for( unsigned i = 0 ; i < num_workers ; i++ )
+      workers.emplace_back( &RenderDaemon::workerThread, this );
+
+   while ( true )
+   {
+      {
+         std::lock_guard<std::mutex> lock( mtx );
+         if ( stopping )
+            break ;
+      }
+      pollfd pfd = { listen_fd, POLLIN, 0 } ;
+      if ( ::poll( &pfd, 1, poll_ms ) <= 0 )
+         continue ;
+      const int fd = ::accept( listen_fd, nullptr, nullptr );
+      if ( fd < 0 )
+         continue ;
+
+      std::lock_guard<std::mutex> lock( mtx );
+      pending.push_back( fd );
+      cond.notify_one();
+
+      std::lock_guard<std::mutex> slock( stats_mtx );
+      max_queue_depth = std::max( max_queue_depth, pending.size() );
+   }
+
+   cond.notify_all();
+   for( std::thread & t : workers )
+      t.join();
+   workers.clear();
+}
+// -----------------------------------------------------------------------------
+
+void RenderDaemon::workerThread()
+{
+   while ( true )
+   {
+      int fd ;
+      {
+         std::unique_lock<std::mutex> lock( mtx );
+         cond.wait( lock, [this]{ return stopping || ! pending.empty() ; } );
+         if ( stopping )
+            return ;
+         fd = pending.front() ;
+         pending.pop_front();
+      }
+      serve( fd );
+      ::close( fd );
+   }
+}
+// -----------------------------------------------------------------------------
+// read a line (without the new line) from 'fd', 'buffer' keeps the bytes read
+// after it. Returns false on end of file, errors, too long lines, or 'stop'.
+
+bool RenderDaemon::readLine( int fd, std::string & buffer, std::string & line )
+{
+   while ( true )
+   {
+      const std::size_t eol = buffer.find( '\n' );
+      if ( eol != std::string::npos )
+      {
+         line = buffer.substr( 0, eol );
+         buffer.erase( 0, eol+1 );
+         return true ;
+      }
+      if ( buffer.size() > max_request_length )
+         return false ;
+      {
+         std::lock_guard<std::mutex> lock( mtx );
+         if ( stopping )
+            return false ;
+      }
+      pollfd pfd = { fd, POLLIN, 0 } ;
+      const int r = ::poll( &pfd, 1, poll_ms );
+      if ( r == 0 || ( r < 0 && errno == EINTR ) )
+         continue ;
+      char chunk[1024] ;
+      const ssize_t n = r < 0 ? -1 : ::recv( fd, chunk, sizeof(chunk), 0 );
+      if ( n <= 0 )
+         return false ;
+      buffer.append( chunk, std::size_t( n ) );
+   }
+}
+// -----------------------------------------------------------------------------
+
+void RenderDaemon::serve( int fd )
+{
+   std::string buffer, line ;
+   while ( readLine( fd, buffer, line ) )
+   {
+      const double t0 = seconds_now() ;
+      {
+         std::lock_guard<std::mutex> lock( stats_mtx );
+         busy_workers++ ;
+      }
+
+      std::string reply ;
+      bool ok = true ;
+      try
+      {
+         const std::string bytes = handle( line );
+         reply = "ok " + std::to_string( bytes.size() ) + "\n" + bytes ;
+      }
+      catch( std::exception & e )
+      {
+         reply = std::string( "error " ) + e.what() + "\n" ;
+         ok = false ;
+      }
+      const bool sent = send_all( fd, reply.data(), reply.size() );
+
+      {
+         std::lock_guard<std::mutex> lock( stats_mtx );
+         busy_workers-- ;
+      }
+      recordLatency( seconds_now()-t0, ok );
+      if ( ! sent )
+         return ;
+   }
+}
+// -----------------------------------------------------------------------------
+
+std::string RenderDaemon::handle( const std::string & line )
+{
+   std::istringstream is( line );
+   std::string command ;
+   is >> command ;
+
+   if ( command == "stats" )
+      return statsText() ;
+   if ( command == "shutdown" )
+   {
+      stop();
+      return "" ;
+   }
+   if ( command != "render" )
+      throw std::runtime_error( "unknown request '" + command + "'" );
+
+   int         num ;
+   std::string format ;
+   if ( ! ( is >> num >> format ) )
+      throw std::runtime_error( "usage: render <figure> <svg|png|pdf> [width <pixels>] [camera <9 numbers>]" );
+
+   unsigned          width_px = 1024 ;
+   std::vector<real> camera ;
+   std::string       option ;
+   while ( is >> option )
+   {
+      if ( option == "width" && is >> width_px && 0 < width_px )
+         continue ;
+      if ( option == "camera" )
+      {
+         camera.resize( 9 );
+         for( real & c : camera )
+            if ( ! ( is >> c ) )
+               throw std::runtime_error( "camera needs nine numbers (look at, observer and up vectors)" );
+         continue ;
+      }
+      throw std::runtime_error( "invalid option '" + option + "'" );
+   }
+
+   std::shared_ptr<CachedFigure> cf = cachedFigure( num, camera );
+   std::lock_guard<std::mutex> lock( cf->mtx );
+   if ( cf->fig == nullptr ) // (building it failed on another thread)
+      throw std::runtime_error( "cannot build figure number " + std::to_string( num ) );
+   return cf->fig->drawBytes( format, width_px );
+}
+// -----------------------------------------------------------------------------
+// the figure number 'num', built and projected with 'camera' (when not empty)
+
+std::shared_ptr<RenderDaemon::CachedFigure> RenderDaemon::cachedFigure( int num, const std::vector<real> & camera )
+{
+   std::ostringstream key ;
+   key << num ;
+   for( real c : camera )
+      key << " " << c ;
+
+   std::shared_ptr<CachedFigure> cf ;
+   {
+      std::lock_guard<std::mutex> lock( cache_mtx );
+      auto it = cache.find( key.str() );
+      if ( it != cache.end() )
+         return it->second ;
+
+      cf = std::make_shared<CachedFigure>() ;
+      cache[key.str()] = cf ;
+      cache_order.push_back( key.str() );
+      if ( cache_order.size() > max_cached_figures ) // (figures in use are kept alive by their users)
+      {
+         cache.erase( cache_order.front() );
+         cache_order.pop_front();
+      }
+   }
+
+   // build outside the cache lock (other requests for this figure wait on its mutex)
+   std::lock_guard<std::mutex> lock( cf->mtx );
+   try
+   {
+      std::unique_ptr<Figure> fig( new_figure( num ) );
+      if ( fig == nullptr )
+         throw std::runtime_error( "there is no figure number " + std::to_string( num ) );
+      if ( ! camera.empty() )
+      {
+         fig->cam = Camera( vec3( camera[0], camera[1], camera[2] ),
+                            vec3( camera[3], camera[4], camera[5] ),
+                            vec3( camera[6], camera[7], camera[8] ) );
+      }
+      vec2 box_min, box_w ;
+      fig->viewBox( box_min, box_w ); // (projects it)
+      cf->fig = std::move( fig );
+   }
+   catch( ... )
+   {
+      std::lock_guard<std::mutex> clock( cache_mtx );
+      auto it = cache.find( key.str() );
+      if ( it != cache.end() && it->second == cf )
+      {
+         cache.erase( it );
+         cache_order.erase( std::find( cache_order.begin(), cache_order.end(), key.str() ) );
+      }
+      throw ;
+   }
+   return cf ;
+}
+// -----------------------------------------------------------------------------
+
+void RenderDaemon::recordLatency( double seconds, bool ok )
+{
+   std::lock_guard<std::mutex> lock( stats_mtx );
+   requests++ ;
+   if ( ! ok )
+      errors++ ;
+   latency_sum += seconds ;
+   latency_max  = std::max( latency_max, seconds );
+   if ( recent_latencies.size() < num_recent_latencies )
+      recent_latencies.push_back( seconds );
+   else
+      recent_latencies[recent_next] = seconds ;
+   recent_next = ( recent_next+1 ) % num_recent_latencies ;
+}
+// -----------------------------------------------------------------------------
+
+std::string RenderDaemon::statsText()
+{
+   std::size_t queue_depth ;
+   {
+      std::lock_guard<std::mutex> lock( mtx );
+      queue_depth = pending.size() ;
+   }
+   std::size_t cached ;
+   {
+      std::lock_guard<std::mutex> lock( cache_mtx );
+      cached = cache.size() ;
+   }
+
+   std::lock_guard<std::mutex> lock( stats_mtx );
+   std::vector<double> sorted( recent_latencies );
+   std::sort( sorted.begin(), sorted.end() );
+   const auto percentile = [&sorted]( double p )
+   {
+      return sorted.empty() ? 0.0 : sorted[ std::size_t( p*double( sorted.size()-1 ) + 0.5 ) ] ;
+   };
+   const double ms = 1000.0 ;
+
+   std::ostringstream os ;
+   os << "queue_depth "       << queue_depth << "\n"
+      << "max_queue_depth "   << max_queue_depth << "\n"
+      << "busy_workers "      << busy_workers << " of " << num_workers << "\n"
+      << "cached_figures "    << cached << "\n"
+      << "requests "          << requests << "\n"
+      << "errors "            << errors << "\n"
+      << "latency_mean_ms "   << ( requests == 0 ? 0.0 : ms*latency_sum/double(requests) ) << "\n"
+      << "latency_max_ms "    << ms*latency_max << "\n"
+      << "latency_p50_ms "    << ms*percentile( 0.50 ) << " (last " << sorted.size() << " requests)\n"
+      << "latency_p99_ms "    << ms*percentile( 0.99 ) << "\n" ;
+   return os.str() ;
+}
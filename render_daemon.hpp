@@ -0,0 +1,115 @@
+// *********************************************************************
+// **
+// ** File: render_daemon.hpp
+// ** Declarations for a render server on a Unix domain socket
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef RENDER_DAEMON_HPP
+#define RENDER_DAEMON_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "svgobjects.hpp"
+
+// *****************************************************************************
+// class RenderDaemon
+// A server which renders figures on request, listening on a Unix domain socket.
+// Built (and projected) figures are kept in memory between requests, so only
+// the output is generated each time. Connections are served by a pool of
+// worker threads, each connection can send any number of requests.
+//
+// Requests are text lines:
+//
+//    render <figure> <svg|png|pdf> [width <pixels>] [camera <look_at> <observer> <vup>]
+//    stats
+//    shutdown
+//
+// (figure numbers as in 'new_figure', camera vectors as three numbers each).
+// Replies are 'ok <n>' followed by a new line and n bytes (the file contents,
+// or the statistics as text), or 'error <message>' and a new line.
+
+class RenderDaemon
+{
+   public:
+
+   // create the socket (an existing socket file at that path is replaced)
+   // (throws std::runtime_error when the socket cannot be created)
+   RenderDaemon( const std::string & p_socket_path, unsigned p_num_workers ) ;
+   ~RenderDaemon() ;
+
+   // serve requests until 'stop' is called or a 'shutdown' request arrives
+   void run() ;
+   void stop() ;
+
+   // queue depth, counters and latencies, as text lines
+   std::string statsText() ;
+
+   // number of figures (each one with a camera) kept in memory at most
+   static constexpr std::size_t max_cached_figures = 64 ;
+
+   private:
+
+   RenderDaemon( const RenderDaemon & ) = delete ;
+   RenderDaemon & operator = ( const RenderDaemon & ) = delete ;
+
+   // a built figure, projected with a camera. Its mutex serializes its use.
+   class CachedFigure
+   {
+      public:
+      std::mutex              mtx ;
+      std::unique_ptr<Figure> fig ;
+   } ;
+
+   std::shared_ptr<CachedFigure> cachedFigure( int num, const std::vector<real> & camera ) ;
+   void        workerThread() ;
+   void        serve( int fd ) ;
+   bool        readLine( int fd, std::string & buffer, std::string & line ) ;
+   std::string handle( const std::string & line ) ;
+   void        recordLatency( double seconds, bool ok ) ;
+
+   std::string   socket_path ;
+   int           listen_fd ;
+   unsigned      num_workers ;
+   bool          stopping ;      // (guarded by 'mtx')
+
+   std::mutex               mtx ;      // guards the connections queue and 'stopping'
+   std::condition_variable  cond ;
+   std::deque<int>          pending ;  // accepted connections not served yet
+   std::vector<std::thread> workers ;
+
+   std::mutex                                            cache_mtx ;
+   std::map< std::string, std::shared_ptr<CachedFigure> > cache ;      // key: figure and camera
+   std::deque< std::string >                              cache_order ; // keys, oldest first
+
+   std::mutex            stats_mtx ;
+   std::uint64_t         requests, errors ;
+   std::size_t           busy_workers, max_queue_depth ;
+   double                latency_sum, latency_max ; // seconds
+   std::vector<double>   recent_latencies ;         // last requests (a ring buffer)
+   std::size_t           recent_next ;
+} ;
+
+#endif
@@ -0,0 +1,86 @@
+// *********************************************************************
+// **
+// ** File: render_sink.cpp
+// ** Implementation of backend-neutral drawing primitives
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cassert>
+#include "render_sink.hpp"
+
+// *****************************************************************************
+// class RenderSink
+// -----------------------------------------------------------------------------
+
+RenderSink::~RenderSink()
+{
+}
+
+// *****************************************************************************
+// class RenderSinks
+// -----------------------------------------------------------------------------
+
+void RenderSinks::add( RenderSink * sink )
+{
+   assert( sink != nullptr && sink != this );
+   sinks.push_back( sink );
+}
+// -----------------------------------------------------------------------------
+
+void RenderSinks::fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity )
+{
+   for( RenderSink * sink : sinks )
+      sink->fillPolygon( pts, color, opacity );
+}
+// -----------------------------------------------------------------------------
+
+void RenderSinks::fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                       const Vec2f & box_min, const Vec2f & box_size, float opacity )
+{
+   for( RenderSink * sink : sinks )
+      sink->fillPolygonGradient( pts, grad, box_min, box_size, opacity );
+}
+// -----------------------------------------------------------------------------
+
+void RenderSinks::strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                  float dash_length, const Vec3f & color )
+{
+   for( RenderSink * sink : sinks )
+      sink->strokePolyline( pts, closed, width, dash_length, color );
+}
+// -----------------------------------------------------------------------------
+
+void RenderSinks::fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity )
+{
+   for( RenderSink * sink : sinks )
+      sink->fillCircle( center, radius, color, opacity );
+}
+// -----------------------------------------------------------------------------
+
+void RenderSinks::fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad,
+                                      float opacity )
+{
+   for( RenderSink * sink : sinks )
+      sink->fillCircleGradient( center, radius, grad, opacity );
+}
+// -----------------------------------------------------------------------------
+
+void RenderSinks::strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color )
+{
+   for( RenderSink * sink : sinks )
+      sink->strokeCircle( center, radius, width, color );
+}
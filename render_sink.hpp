@@ -0,0 +1,85 @@
+// *********************************************************************
+// **
+// ** File: render_sink.hpp
+// ** Declarations for backend-neutral drawing primitives
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef RENDER_SINK_HPP
+#define RENDER_SINK_HPP
+
+#include <vector>
+#include "vector_templates.hpp"
+#include "radial_gradient.hpp"
+
+// *****************************************************************************
+// class RenderSink
+// An abstract output backend (other than SVG): the drawing primitives used by
+// the objects, in projected coordinates (y upwards). Gradients are given in
+// units of the box with lower-left corner 'box_min' and size 'box_size'.
+
+class RenderSink
+{
+   public:
+
+   // fill a polygon (implicitly closed, non-zero rule) with a solid color
+   virtual void fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity ) = 0 ;
+
+   // fill a polygon with a radial gradient
+   virtual void fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                     const Vec2f & box_min, const Vec2f & box_size, float opacity ) = 0 ;
+
+   // stroke a polyline (round caps and joins), dashed when 'dash_length' > 0
+   virtual void strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                float dash_length, const Vec3f & color ) = 0 ;
+
+   // fill and stroke circles
+   virtual void fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity ) = 0 ;
+   virtual void fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad,
+                                    float opacity ) = 0 ;
+   virtual void strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color ) = 0 ;
+
+   virtual ~RenderSink() ;
+} ;
+
+// *****************************************************************************
+// class RenderSinks
+// A sink which forwards each primitive to several sinks (in the order they were
+// added), so a single traversal of the objects feeds all of them.
+
+class RenderSinks : public RenderSink
+{
+   public:
+
+   void add( RenderSink * sink ) ;
+   bool empty() const { return sinks.empty() ; }
+
+   virtual void fillPolygon( const std::vector<Vec2f> & pts, const Vec3f & color, float opacity ) ;
+   virtual void fillPolygonGradient( const std::vector<Vec2f> & pts, const RadialGradient & grad,
+                                     const Vec2f & box_min, const Vec2f & box_size, float opacity ) ;
+   virtual void strokePolyline( const std::vector<Vec2f> & pts, bool closed, float width,
+                                float dash_length, const Vec3f & color ) ;
+   virtual void fillCircle( const Vec2f & center, float radius, const Vec3f & color, float opacity ) ;
+   virtual void fillCircleGradient( const Vec2f & center, float radius, const RadialGradient & grad,
+                                    float opacity ) ;
+   virtual void strokeCircle( const Vec2f & center, float radius, float width, const Vec3f & color ) ;
+
+   private:
+   std::vector<RenderSink *> sinks ;
+} ;
+
+#endif
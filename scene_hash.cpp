@@ -0,0 +1,168 @@
+// *********************************************************************
+// **
+// ** File: scene_hash.cpp
+// ** Implementation of stable hashes of figures, and a manifest of outputs
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scene_hash.hpp"
+
+// *****************************************************************************
+// class SceneHasher
+// -----------------------------------------------------------------------------
+
+SceneHasher::SceneHasher()
+{
+   state = 14695981039346656037ull ; // FNV-1a offset basis
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( const void * bytes, std::size_t n )
+{
+   const unsigned char * p = static_cast<const unsigned char *>( bytes );
+   for( std::size_t i = 0 ; i < n ; i++ )
+   {
+      state ^= p[i] ;
+      state *= 1099511628211ull ; // FNV-1a prime
+   }
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( bool v )
+{
+   const unsigned char b = v ? 1 : 0 ;
+   add( &b, 1 );
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( int v )
+{
+   add( std::uint64_t( std::int64_t( v ) ) );
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( std::uint64_t v )
+{
+   add( &v, sizeof(v) );
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( float v )
+{
+   if ( v == 0.0f ) // +0 and -0 produce the same output
+      v = 0.0f ;
+   add( &v, sizeof(v) );
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( double v )
+{
+   if ( v == 0.0 )
+      v = 0.0 ;
+   add( &v, sizeof(v) );
+}
+// -----------------------------------------------------------------------------
+
+void SceneHasher::add( const std::string & s )
+{
+   add( std::uint64_t( s.size() ) );
+   add( s.data(), s.size() );
+}
+// -----------------------------------------------------------------------------
+
+std::string SceneHasher::hex() const
+{
+   char buf[32] ;
+   std::snprintf( buf, sizeof(buf), "%016llx", (unsigned long long) state );
+   return buf ;
+}
+
+// *****************************************************************************
+// class HashManifest
+// -----------------------------------------------------------------------------
+
+HashManifest::HashManifest( const std::string & p_path )
+{
+   path    = p_path ;
+   entries = read( path );
+}
+// -----------------------------------------------------------------------------
+
+std::map<std::string,std::string> HashManifest::read( const std::string & path )
+{
+   std::map<std::string,std::string> res ;
+   std::ifstream in( path );   // (a missing manifest is just empty)
+   std::string hash, file ;
+   while ( in >> hash && std::getline( in >> std::ws, file ) )
+      res[file] = hash ;
+   return res ;
+}
+// -----------------------------------------------------------------------------
+
+bool HashManifest::upToDate( const std::string & file, const std::string & hash ) const
+{
+   auto it = entries.find( file );
+   if ( it == entries.end() || it->second != hash )
+      return false ;
+   struct stat st ;
+   return ::stat( file.c_str(), &st ) == 0 ;
+}
+// -----------------------------------------------------------------------------
+
+void HashManifest::update( const std::string & file, const std::string & hash )
+{
+   entries[file] = hash ;
+
+   const std::string lock_path = path + ".lock" ;
+   const int lock_fd = ::open( lock_path.c_str(), O_RDWR | O_CREAT, 0644 );
+   if ( lock_fd < 0 || ::flock( lock_fd, LOCK_EX ) != 0 )
+   {
+      const std::string msg = "cannot lock '" + lock_path + "': " + std::strerror( errno ) ;
+      if ( 0 <= lock_fd )
+         ::close( lock_fd );
+      throw std::runtime_error( msg );
+   }
+
+   // merge with entries written by other processes, then replace the file
+   std::map<std::string,std::string> merged = read( path );
+   merged[file] = hash ;
+
+   const std::string tmp_path = path + ".tmp" ;
+   bool ok ;
+   {
+      std::ofstream out( tmp_path );
+      for( const auto & e : merged )
+         out << e.second << " " << e.first << "\n" ;
+      out.close();
+      ok = ! out.fail() && std::rename( tmp_path.c_str(), path.c_str() ) == 0 ;
+   }
+   ::close( lock_fd ); // (releases the lock)
+
+   if ( ! ok )
+      throw std::runtime_error( "cannot write manifest '" + path + "'" );
+}
@@ -0,0 +1,87 @@
+// *********************************************************************
+// **
+// ** File: scene_hash.hpp
+// ** Declarations for stable hashes of figures, and a manifest of outputs
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef SCENE_HASH_HPP
+#define SCENE_HASH_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include "vector_templates.hpp"
+
+// *****************************************************************************
+// class SceneHasher
+// Incremental 64-bit FNV-1a hash. It is stable across runs and platforms with
+// the same byte order: values are hashed by their bit patterns, strings are
+// prefixed by their length.
+
+class SceneHasher
+{
+   public:
+   SceneHasher() ;
+
+   void add( const void * bytes, std::size_t n ) ;
+   void add( bool v ) ;
+   void add( int v ) ;
+   void add( std::uint64_t v ) ;
+   void add( float v ) ;
+   void add( double v ) ;
+   void add( const std::string & s ) ;
+   void add( const char * s ) { add( std::string( s ) ); }
+
+   template< class T > void add( const VectorTempl2<T> & v ) { add( v[0] ); add( v[1] ); }
+   template< class T > void add( const VectorTempl3<T> & v ) { add( v[0] ); add( v[1] ); add( v[2] ); }
+   template< class T > void add( const VectorTempl4<T> & v ) { add( v[0] ); add( v[1] ); add( v[2] ); add( v[3] ); }
+
+   std::uint64_t value() const { return state ; }
+   std::string   hex() const ; // 16 hexadecimal digits
+
+   private:
+   std::uint64_t state ;
+} ;
+
+// *****************************************************************************
+// class HashManifest
+// A text file with one line for each output file: the hash of the figure and
+// options it was written from, and the file name. Updates are merged with the
+// current contents of the file under an exclusive lock (on '<path>.lock'), so
+// several processes (e.g. 'make -j') can share a manifest.
+
+class HashManifest
+{
+   public:
+   HashManifest( const std::string & p_path ) ;
+
+   // true when 'file' exists and was written from a figure with hash 'hash'
+   bool upToDate( const std::string & file, const std::string & hash ) const ;
+
+   // record that 'file' has been written from a figure with hash 'hash'
+   // (throws std::runtime_error when the manifest cannot be written)
+   void update( const std::string & file, const std::string & hash ) ;
+
+   private:
+   static std::map<std::string,std::string> read( const std::string & path ) ;
+
+   std::string                        path ;
+   std::map<std::string,std::string>  entries ; // file name --> hash
+} ;
+
+#endif
@@ -0,0 +1,302 @@
+// *********************************************************************
+// **
+// ** File: svg_size.cpp
+// ** Implementation of the accounting of the bytes of SVG outputs, and of
+// ** baselines of output sizes
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "svg_size.hpp"
+
+// *****************************************************************************
+// class CountingStreamBuf
+// -----------------------------------------------------------------------------
+
+CountingStreamBuf::CountingStreamBuf( std::streambuf * p_target )
+{
+   target = p_target ;
+   count  = 0 ;
+}
+// -----------------------------------------------------------------------------
+
+CountingStreamBuf::int_type CountingStreamBuf::overflow( int_type c )
+{
+   if ( traits_type::eq_int_type( c, traits_type::eof() ) )
+      return traits_type::not_eof( c );
+   if ( target != nullptr &&
+        traits_type::eq_int_type( target->sputc( traits_type::to_char_type( c ) ), traits_type::eof() ) )
+      return traits_type::eof();
+   count++ ;
+   return c ;
+}
+// -----------------------------------------------------------------------------
+
+std::streamsize CountingStreamBuf::xsputn( const char * s, std::streamsize n )
+{
+   const std::streamsize written = ( target != nullptr ) ? target->sputn( s, n ) : n ;
+   count += std::size_t( written );
+   return written ;
+}
+// -----------------------------------------------------------------------------
+
+int CountingStreamBuf::sync()
+{
+   return ( target != nullptr ) ? target->pubsync() : 0 ;
+}
+
+// *****************************************************************************
+// class SVGSizeStats
+// -----------------------------------------------------------------------------
+
+SVGSizeStats::SVGSizeStats()
+{
+   counter = nullptr ;
+   reset();
+}
+// -----------------------------------------------------------------------------
+
+void SVGSizeStats::reset()
+{
+   for( unsigned k = 0 ; k < num_svg_bytes_kinds ; k++ )
+      by_kind[k] = 0 ;
+   by_type.clear();
+   tagged = 0 ;
+   typed  = 0 ;
+}
+// -----------------------------------------------------------------------------
+
+SVGSizeMark SVGSizeStats::mark() const
+{
+   SVGSizeMark m ;
+   m.position = ( counter != nullptr ) ? counter->count : 0 ;
+   m.tagged   = tagged ;
+   m.typed    = typed ;
+   return m ;
+}
+// -----------------------------------------------------------------------------
+
+void SVGSizeStats::add( SVGBytes kind, std::size_t n )
+{
+   by_kind[unsigned(kind)] += n ;
+   tagged += n ;
+}
+// -----------------------------------------------------------------------------
+
+void SVGSizeStats::add( SVGBytes kind, const SVGSizeMark & from )
+{
+   assert( counter != nullptr );
+   // (bytes already tagged since 'from', by nested writers, are not tagged again)
+   const std::size_t written = counter->count - from.position,
+                     inner   = tagged - from.tagged ;
+   assert( inner <= written );
+   add( kind, written - inner );
+}
+// -----------------------------------------------------------------------------
+
+void SVGSizeStats::addObject( const std::string & type, const SVGSizeMark & from )
+{
+   assert( counter != nullptr );
+   add( SVGBytes::Markup, from );   // (untagged bytes of the object)
+
+   const std::size_t written = counter->count - from.position,
+                     inner   = typed - from.typed ;
+   assert( inner <= written );
+   if ( written > inner )
+      by_type[type] += written - inner ;
+   typed += written - inner ;
+}
+// -----------------------------------------------------------------------------
+
+std::size_t SVGSizeStats::total() const
+{
+   std::size_t sum = 0 ;
+   for( unsigned k = 0 ; k < num_svg_bytes_kinds ; k++ )
+      sum += by_kind[k] ;
+   return sum ;
+}
+// -----------------------------------------------------------------------------
+
+const char * SVGSizeStats::name( SVGBytes kind )
+{
+   switch( kind )
+   {
+      case SVGBytes::Header   : return "header" ;
+      case SVGBytes::Defs     : return "defs" ;
+      case SVGBytes::Use      : return "use" ;
+      case SVGBytes::Style    : return "style" ;
+      case SVGBytes::PathData : return "path-data" ;
+      case SVGBytes::Circles  : return "circles" ;
+      case SVGBytes::Markup   : return "markup" ;
+   }
+   return "?" ;
+}
+// -----------------------------------------------------------------------------
+
+void SVGSizeStats::report( std::ostream & os ) const
+{
+   const std::size_t sum = total() ;
+   const auto line = [&]( const std::string & what, std::size_t n )
+   {
+      os << "   " << std::left << std::setw(28) << what << std::right << std::setw(12) << n ;
+      if ( sum > 0 )
+         os << std::setw(8) << std::fixed << std::setprecision(1) << (100.0*double(n))/double(sum) << " %" ;
+      os << std::endl ;
+   };
+
+   os << "bytes by kind:" << std::endl ;
+   for( unsigned k = 0 ; k < num_svg_bytes_kinds ; k++ )
+      line( name( SVGBytes(k) ), by_kind[k] );
+   line( "total", sum );
+
+   if ( by_type.size() == 0 )
+      return ;
+   os << "bytes by type of object:" << std::endl ;
+   for( const auto & e : by_type )
+      line( e.first, e.second );
+}
+
+// *****************************************************************************
+// class SizeBaseline
+// -----------------------------------------------------------------------------
+
+SizeBaseline::SizeBaseline( const std::string & p_path )
+{
+   path    = p_path ;
+   entries = read( path );
+}
+// -----------------------------------------------------------------------------
+
+SizeBaseline::Entries SizeBaseline::read( const std::string & path )
+{
+   Entries res ;
+   std::ifstream in( path );   // (a missing baseline is just empty)
+   std::string figure_id, what ;
+   std::size_t n ;
+   while ( in >> figure_id >> what >> n )
+      res[figure_id][what] = n ;
+   return res ;
+}
+// -----------------------------------------------------------------------------
+
+std::map<std::string,std::size_t> SizeBaseline::values( const SVGSizeStats & stats )
+{
+   std::map<std::string,std::size_t> res ;
+   for( unsigned k = 0 ; k < num_svg_bytes_kinds ; k++ )
+      res[SVGSizeStats::name( SVGBytes(k) )] = stats.by_kind[k] ;
+   res["total"] = stats.total() ;
+   for( const auto & e : stats.by_type )
+      res["type:"+e.first] = e.second ;
+   return res ;
+}
+// -----------------------------------------------------------------------------
+
+bool SizeBaseline::has( const std::string & figure_id ) const
+{
+   return entries.find( figure_id ) != entries.end() ;
+}
+// -----------------------------------------------------------------------------
+
+bool SizeBaseline::check( const std::string & figure_id, const SVGSizeStats & stats,
+                          double threshold, std::ostream & report )
+{
+   assert( 0.0 <= threshold );
+
+   if ( ! has( figure_id ) )
+   {
+      report << "no size baseline for '" << figure_id << "', recording it in '" << path << "'" << std::endl ;
+      update( figure_id, stats );
+      return true ;
+   }
+
+   // compare every value (kinds, then types), but only the total can fail
+   const std::map<std::string,std::size_t> & base = entries[figure_id] ;
+   const std::map<std::string,std::size_t>   curr = values( stats ) ;
+   std::map<std::string,std::size_t> names( base );
+   names.insert( curr.begin(), curr.end() );
+
+   report << "size of '" << figure_id << "' (baseline, current, change):" << std::endl ;
+   for( const auto & e : names )
+   {
+      const auto ib = base.find( e.first ), ic = curr.find( e.first );
+      const std::size_t b = ( ib != base.end() ) ? ib->second : 0,
+                        c = ( ic != curr.end() ) ? ic->second : 0 ;
+      report << "   " << std::left << std::setw(28) << e.first << std::right
+             << std::setw(12) << b << std::setw(12) << c
+             << std::setw(12) << std::showpos << ( (long long)c - (long long)b ) << std::noshowpos ;
+      if ( b > 0 && b != c )
+         report << std::setw(9) << std::fixed << std::setprecision(2) << std::showpos
+                << 100.0*( double(c)/double(b) - 1.0 ) << std::noshowpos << " %" ;
+      report << std::endl ;
+   }
+
+   const auto it = base.find( "total" );
+   const double limit = ( it != base.end() ) ? double( it->second )*( 1.0 + threshold ) : 0.0 ;
+   if ( it != base.end() && double( stats.total() ) > limit )
+   {
+      report << "ERROR: the output of '" << figure_id << "' grew beyond the baseline ("
+             << stats.total() << " > " << std::size_t( limit ) << " bytes)" << std::endl ;
+      return false ;
+   }
+   return true ;
+}
+// -----------------------------------------------------------------------------
+
+void SizeBaseline::update( const std::string & figure_id, const SVGSizeStats & stats )
+{
+   entries[figure_id] = values( stats );
+
+   const std::string lock_path = path + ".lock" ;
+   const int lock_fd = ::open( lock_path.c_str(), O_RDWR | O_CREAT, 0644 );
+   if ( lock_fd < 0 || ::flock( lock_fd, LOCK_EX ) != 0 )
+   {
+      const std::string msg = "cannot lock '" + lock_path + "': " + std::strerror( errno ) ;
+      if ( 0 <= lock_fd )
+         ::close( lock_fd );
+      throw std::runtime_error( msg );
+   }
+
+   // merge with baselines written by other processes, then replace the file
+   Entries merged = read( path );
+   merged[figure_id] = entries[figure_id] ;
+
+   const std::string tmp_path = path + ".tmp" ;
+   bool ok ;
+   {
+      std::ofstream out( tmp_path );
+      for( const auto & f : merged )
+         for( const auto & e : f.second )
+            out << f.first << " " << e.first << " " << e.second << "\n" ;
+      out.close();
+      ok = ! out.fail() && std::rename( tmp_path.c_str(), path.c_str() ) == 0 ;
+   }
+   ::close( lock_fd ); // (releases the lock)
+
+   if ( ! ok )
+      throw std::runtime_error( "cannot write size baseline '" + path + "'" );
+}
@@ -0,0 +1,145 @@
+// *********************************************************************
+// **
+// ** File: svg_size.hpp
+// ** Accounting of the bytes of SVG outputs, by kind of content and by type
+// ** of object, and baselines of output sizes
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef SVG_SIZE_HPP
+#define SVG_SIZE_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <streambuf>
+#include <string>
+
+// *****************************************************************************
+// class CountingStreamBuf
+// A stream buffer which counts the characters written, and passes them on to
+// another stream buffer (or discards them, when it is null). It is unbuffered.
+
+class CountingStreamBuf : public std::streambuf
+{
+   public:
+   CountingStreamBuf( std::streambuf * p_target = nullptr ) ;
+   std::size_t count ;  // characters written so far
+
+   protected:
+   virtual int_type overflow( int_type c ) ;
+   virtual std::streamsize xsputn( const char * s, std::streamsize n ) ;
+   virtual int sync() ;
+
+   private:
+   std::streambuf * target ;
+} ;
+
+// *****************************************************************************
+// kinds of content of an SVG file:
+//   Header   : <svg>, the global transform and the end tags
+//   Defs     : the <defs> section (gradients and repeated subgraphs)
+//   Use      : <use> elements (see SVGDefs)
+//   Style    : 'style' attributes of paths and circles
+//   PathData : 'd' attributes of paths
+//   Circles  : <circle> elements (but their 'style' attributes)
+//   Markup   : the rest of the elements (tags, other attributes, whitespace)
+
+enum class SVGBytes : unsigned
+{
+   Header, Defs, Use, Style, PathData, Circles, Markup
+} ;
+constexpr unsigned num_svg_bytes_kinds = 7 ;
+
+// *****************************************************************************
+// class SVGSizeStats
+// Bytes of an SVG output, by kind of content and by type of object. Writers tag
+// the bytes they write with a kind, either by number or from a mark (a position
+// in the output) on; the bytes written by each object and not tagged are Markup.
+// Bytes of nested objects are attributed to the innermost object type.
+
+class SVGSizeMark
+{
+   public:
+   std::size_t position, tagged, typed ;
+} ;
+
+class SVGSizeStats
+{
+   public:
+   SVGSizeStats() ;
+   void reset() ;
+
+   // the stream buffer whose count is the current position (set by the figure)
+   void setCounter( const CountingStreamBuf * p_counter ) { counter = p_counter ; }
+
+   SVGSizeMark mark() const ;
+   void add( SVGBytes kind, std::size_t n ) ;             // tag 'n' bytes
+   void add( SVGBytes kind, const SVGSizeMark & from ) ;  // tag the bytes written since 'from'
+
+   // end of the output of an object of type 'type' which started at 'from'
+   void addObject( const std::string & type, const SVGSizeMark & from ) ;
+
+   std::size_t total() const ; // all the bytes tagged
+   std::size_t bytes( SVGBytes kind ) const { return by_kind[unsigned(kind)] ; }
+   static const char * name( SVGBytes kind ) ;
+
+   // write a table with the bytes by kind and by type of object
+   void report( std::ostream & os ) const ;
+
+   std::size_t by_kind[num_svg_bytes_kinds] ;
+   std::map<std::string,std::size_t> by_type ;
+
+   private:
+   const CountingStreamBuf * counter ;
+   std::size_t tagged, typed ;  // bytes tagged with a kind, and attributed to a type, so far
+} ;
+
+// *****************************************************************************
+// class SizeBaseline
+// A text file with the output size of each figure: one line for each figure
+// id, kind of content (and 'total', and 'type:<name>' for types of objects),
+// with the number of bytes. Updates are merged with the current contents, under
+// an exclusive lock (as HashManifest).
+
+class SizeBaseline
+{
+   public:
+   SizeBaseline( const std::string & p_path ) ;
+
+   bool has( const std::string & figure_id ) const ;
+
+   // compare 'stats' with the baseline of 'figure_id' (writing a line for each
+   // value to 'report'), true unless the total grew by more than 'threshold'
+   // (relative). Without a baseline, 'stats' are recorded as the baseline.
+   bool check( const std::string & figure_id, const SVGSizeStats & stats,
+               double threshold, std::ostream & report ) ;
+
+   // record 'stats' as the baseline of 'figure_id'
+   // (throws std::runtime_error when the file cannot be written)
+   void update( const std::string & figure_id, const SVGSizeStats & stats ) ;
+
+   private:
+   typedef std::map< std::string, std::map<std::string,std::size_t> > Entries ;
+   static Entries read( const std::string & path ) ;
+   static std::map<std::string,std::size_t> values( const SVGSizeStats & stats ) ;
+
+   std::string path ;
+   Entries     entries ; // figure id --> (kind or type --> bytes)
+} ;
+
+#endif
@@ -20,32 +20,23 @@
 // **
 //
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <typeinfo>
+#include <cxxabi.h>
+#include <memory>
+#include <set>
+#include <stdexcept>
 #include "svgobjects.hpp"
+#include "parallel.hpp"
+#include "gzip_stream.hpp"
+#include "unit_circle.hpp"
 
 // Aux functions
 
 // -----------------------------------------------------------------------------
 
-void write_radial_gradient_def( std::ostream & os, const std::string & name )
-{
-   using namespace std ;
-   os << "<radialGradient id='" << name << "' cx='50%' cy='50%' r='50%' fx='25%' fy='75%'>" << endl
-      << "   <stop offset='0%'   style='stop-color:rgb(100%,100%,100%); stop-opacity:0.2' />" << endl
-      << "   <stop offset='100%' style='stop-color:rgb(20%,20%,20%);    stop-opacity:0.2' />" << endl
-      << "</radialGradient>" << endl ;
-}
-
-// -----------------------------------------------------------------------------
-
-void write_radial_gradient_def_blue( std::ostream & os, const std::string & name )
-{
-   using namespace std ;
-   os << "<radialGradient id='" << name << "' cx='50%' cy='50%' r='50%' fx='50%' fy='50%'>" << endl
-      << "   <stop offset='0%'   style='stop-color:rgb(100%,100%,100%); stop-opacity:0.2' />" << endl
-      << "   <stop offset='100%' style='stop-color:rgb(0%,0%,50%);    stop-opacity:0.4' />" << endl
-      << "</radialGradient>" << endl ;
-}
-
 // -----------------------------------------------------------------------------
 
 void write_color( std::ostream & os, const vec3 & col )
@@ -71,75 +62,114 @@ void write_stroke_color( std::ostream & os, const vec3 & col )
 
 void write_coord2( std::ostream & os, const vec2 & p )
 {
-   using namespace std ;
-   if ( isnan(p[0]) && isnan(p[1]) )
-      cout << "warning: not a number found in vec2. Not written to SVG output file." << endl ;
-   else
-       os << p[0] << " " << p[1] ;
+   // (projected vertexes are validated when projected, see GeometryCheck)
+   os << p[0] << " " << p[1] ;
 }
 
 // *****************************************************************************
-// class CamRefSys
+// class VertexArrayView
 // -----------------------------------------------------------------------------
 
-CamRefSys::CamRefSys()
+VertexArrayView::VertexArrayView()
 {
-  origin = vec3( 0.0, 0.0, 0.0 );
-  xAxis   = vec3( 1.0, 0.0, 0.0 );
-  yAxis   = vec3( 0.0, 1.0, 0.0 );
-  zAxis   = vec3( 0.0, 0.0, 1.0 );
+  data     = nullptr ;
+  count    = 0 ;
+  format   = VertexFormat::Float32 ;
+  num_maps = 0 ;
 }
 // -----------------------------------------------------------------------------
 
-CamRefSys::CamRefSys( const vec3 & look_at, const vec3 & observer, const vec3 & p_vup )
+VertexArrayView::VertexArrayView( const std::vector<vec3> & v )
 {
-  initialize( look_at, observer, p_vup );
+  data   = v.empty() ? nullptr : (const real *) v[0] ;
+  count  = v.size() ;
+#ifdef SIMPLE_PREC
+  format = VertexFormat::Float32 ;
+#else
+  format = VertexFormat::Float64 ;
+#endif
+  num_maps = 0 ;
+  static_assert( sizeof(vec3) == 3*sizeof(real), "vec3 must be a packed xyz triple" );
 }
 // -----------------------------------------------------------------------------
 
-void CamRefSys::initialize( const vec3 & look_at, const vec3 & observer, const vec3 & p_vup )
+VertexArrayView::VertexArrayView( const void * p_data, std::size_t p_count, VertexFormat p_format )
 {
-  constexpr real epsilon = 1e-5 ;
-
-  assert( epsilon <= (observer-look_at).length() ) ;
-
-  origin = observer ;
-  zAxis = (observer-look_at).normalized();
-  xAxis = (p_vup.cross(zAxis)).normalized();  assert( fabs(xAxis.length()-1.0) < epsilon );
-  yAxis = (zAxis.cross(xAxis)).normalized() ; assert( fabs(yAxis.length()-1.0) < epsilon );
-
-  assert( xAxis.dot(yAxis) < epsilon );
-  assert( yAxis.dot(zAxis) < epsilon );
-  assert( zAxis.dot(xAxis) < epsilon );
+  data     = p_data ;
+  count    = p_count ;
+  format   = p_format ;
+  num_maps = 0 ;
 }
 // -----------------------------------------------------------------------------
 
-vec2 CamRefSys::world2cam( const vec3 & p ) const
+void VertexArrayView::readBlock( std::size_t first, std::size_t n, vec3 * out ) const
 {
-  const vec3 v = p-origin ;
-  return vec2( v.dot(xAxis), v.dot(yAxis) ) ;
+  assert( first+n <= count );
+  for( std::size_t i = 0 ; i < n ; i++ )
+    out[i] = read<real>( first+i );
+  for( unsigned k = 0 ; k < num_maps ; k++ )
+    apply_map_batch( maps[k], out, n );
+}
+// -----------------------------------------------------------------------------
 
+VertexArrayView VertexArrayView::mapped( VertexMap m ) const
+{
+  assert( num_maps < max_maps );
+  VertexArrayView res = *this ;
+  res.maps[res.num_maps++] = m ;
+  return res ;
 }
 
 // *****************************************************************************
 // class Camera
 // -----------------------------------------------------------------------------
 
-Camera::Camera()
+static Vec3d to_double( const vec3 & v )
 {
+  return Vec3d( v[0], v[1], v[2] );
+}
+// -----------------------------------------------------------------------------
 
+Camera::Camera()
+{
+  precision = Precision::Single ;
 }
 // -----------------------------------------------------------------------------
 
 Camera::Camera( const vec3 & look_at, const vec3 & observer, const vec3 & p_vup )
 {
   src.initialize( look_at, observer, p_vup );
+  src_d.initialize( to_double( look_at ), to_double( observer ), to_double( p_vup ) );
+  precision = Precision::Single ;
 }
 // -----------------------------------------------------------------------------
 
 vec2 Camera::project( const vec3 & p ) const   // por ahora, solo paralela
 {
-  return src.world2cam( p );
+  if ( precision == Precision::Single )
+    return src.world2cam( p );
+  const Vec2d q = src_d.world2cam( to_double( p ) );
+  return vec2( real(q[0]), real(q[1]) );
+}
+// -----------------------------------------------------------------------------
+
+vec2 Camera::project( const Vec3d & p ) const
+{
+  if ( precision == Precision::Single )
+    return src.world2cam( vec3( real(p[0]), real(p[1]), real(p[2]) ) );
+  const Vec2d q = src_d.world2cam( p );
+  return vec2( real(q[0]), real(q[1]) );
+}
+// -----------------------------------------------------------------------------
+
+void Camera::hash( SceneHasher & h ) const
+{
+  h.add( src.origin );
+  h.add( src.xAxis );
+  h.add( src.yAxis );
+  h.add( src.zAxis );
+  if ( precision != Precision::Single )
+    h.add( int( precision ) );
 }
 
 // *****************************************************************************
@@ -148,7 +178,94 @@ vec2 Camera::project( const vec3 & p ) const   // por ahora, solo paralela
 
 SVGContext::SVGContext()
 {
-  os = nullptr ;
+  os     = nullptr ;
+  offset = vec2( 0.0, 0.0 );
+  defs   = nullptr ;
+  stats  = nullptr ;
+}
+
+// *****************************************************************************
+// class DrawContext
+// -----------------------------------------------------------------------------
+
+DrawContext::DrawContext()
+{
+  svg  = nullptr ;
+  sink = nullptr ;
+}
+
+// *****************************************************************************
+// class GradientRegistry
+// -----------------------------------------------------------------------------
+
+std::map<std::string,RadialGradient> & GradientRegistry::table()
+{
+   // built-in gradients: (cx,cy,r,fx,fy) and the two stops (r,g,b,opacity)
+   static std::map<std::string,RadialGradient> gradients =
+   {
+      { "hemisphereGradFill", { 0.5f, 0.5f, 0.5f, 0.25f, 0.75f, Vec4f( 1.0, 1.0, 1.0, 0.2 ), Vec4f( 0.2, 0.2, 0.2, 0.2 ) } },
+      { "sphereGradFill",     { 0.5f, 0.5f, 0.5f, 0.25f, 0.75f, Vec4f( 1.0, 1.0, 1.0, 0.2 ), Vec4f( 0.2, 0.2, 0.2, 0.2 ) } },
+      { "spherecapGradFill",  { 0.5f, 0.5f, 0.5f, 0.50f, 0.50f, Vec4f( 1.0, 1.0, 1.0, 0.2 ), Vec4f( 0.0, 0.0, 0.5, 0.4 ) } }
+   } ;
+   return gradients ;
+}
+// -----------------------------------------------------------------------------
+
+const RadialGradient & GradientRegistry::get( const std::string & name )
+{
+   const std::map<std::string,RadialGradient> & gradients = table() ;
+   auto it = gradients.find( name );
+   if ( it == gradients.end() )
+   {
+      std::cout << "WARNING: undefined gradient '" << name << "', using 'hemisphereGradFill'." << std::endl ;
+      return gradients.at( "hemisphereGradFill" );
+   }
+   return it->second ;
+}
+// -----------------------------------------------------------------------------
+
+void GradientRegistry::define( const std::string & name, const RadialGradient & grad )
+{
+   table()[name] = grad ;
+}
+// -----------------------------------------------------------------------------
+
+bool GradientRegistry::defined( const std::string & name )
+{
+   return table().count( name ) > 0 ;
+}
+// -----------------------------------------------------------------------------
+
+void GradientRegistry::writeSVG( std::ostream & os, const std::string & name )
+{
+   using namespace std ;
+   const RadialGradient & g = get( name );
+
+   os << "<radialGradient id='" << name << "' cx='" << 100.0f*g.cx << "%' cy='" << 100.0f*g.cy
+      << "%' r='" << 100.0f*g.r << "%' fx='" << 100.0f*g.fx << "%' fy='" << 100.0f*g.fy << "%'>" << endl ;
+   const Vec4f * stops[2] = { &g.stop0, &g.stop1 } ;
+   for( unsigned i = 0 ; i < 2 ; i++ )
+   {
+      const Vec4f & st = *(stops[i]) ;
+      os << "   <stop offset='" << (i == 0 ? "0%" : "100%") << "' style='stop-color:" ;
+      write_color( os, vec3( st[0], st[1], st[2] ) );
+      os << "; stop-opacity:" << st[3] << "' />" << endl ;
+   }
+   os << "</radialGradient>" << endl ;
+}
+// -----------------------------------------------------------------------------
+
+void GradientRegistry::hash( SceneHasher & h, const std::string & name )
+{
+   const RadialGradient & g = get( name );
+   h.add( name );
+   h.add( g.cx );
+   h.add( g.cy );
+   h.add( g.r );
+   h.add( g.fx );
+   h.add( g.fy );
+   h.add( g.stop0 );
+   h.add( g.stop1 );
 }
 
 // *****************************************************************************
@@ -213,6 +330,130 @@ void PathStyle::writeSVG( SVGContext & ctx )
    os << "' " << endl ;
 
 }
+// -----------------------------------------------------------------------------
+
+void PathStyle::hash( SceneHasher & h ) const
+{
+  h.add( lines_color );
+  h.add( fill_color );
+  h.add( draw_lines );
+  h.add( close_lines );
+  h.add( draw_filled );
+  h.add( lines_width );
+  h.add( fill_opacity );
+  h.add( dashed_lines );
+  h.add( use_grad_fill );
+  if ( use_grad_fill )
+    GradientRegistry::hash( h, grad_fill_name );
+}
+// -----------------------------------------------------------------------------
+
+void PathStyle::collectGradients( std::set<std::string> & names ) const
+{
+  if ( draw_filled && use_grad_fill )
+    names.insert( grad_fill_name );
+}
+
+// *****************************************************************************
+// class StyleTable
+// -----------------------------------------------------------------------------
+
+std::mutex & StyleTable::mtx()
+{
+  static std::mutex m ;
+  return m ;
+}
+// -----------------------------------------------------------------------------
+
+std::deque<StyleTable::Entry> & StyleTable::entries()
+{
+  static std::deque<Entry> e ;
+  return e ;
+}
+// -----------------------------------------------------------------------------
+
+std::map<std::string,StyleHandle> & StyleTable::handles()
+{
+  static std::map<std::string,StyleHandle> h ;
+  return h ;
+}
+// -----------------------------------------------------------------------------
+// the key of a style: the bytes of all its fields (equal keys, equal styles)
+
+template< class T >
+static inline void append_bytes( std::string & key, const T & value )
+{
+  key.append( reinterpret_cast<const char *>( &value ), sizeof(T) );
+}
+
+static std::string style_key( const PathStyle & style )
+{
+  std::string key ;
+  for( unsigned i = 0 ; i < 3 ; i++ )
+  {
+    append_bytes( key, style.lines_color[i] );
+    append_bytes( key, style.fill_color[i] );
+  }
+  append_bytes( key, style.lines_width );
+  append_bytes( key, style.fill_opacity );
+  key += char( style.draw_lines    ) ;
+  key += char( style.close_lines   ) ;
+  key += char( style.draw_filled   ) ;
+  key += char( style.dashed_lines  ) ;
+  key += char( style.use_grad_fill ) ;
+  key += style.grad_fill_name ;
+  return key ;
+}
+// -----------------------------------------------------------------------------
+
+StyleHandle StyleTable::intern( const PathStyle & style )
+{
+  const std::string key = style_key( style );
+
+  std::lock_guard<std::mutex> lock( mtx() );
+  auto it = handles().find( key );
+  if ( it != handles().end() )
+    return it->second ;
+
+  // new style: serialized once, with the default format flags (as the SVG stream)
+  Entry entry ;
+  entry.style = style ;
+
+  std::ostringstream attrs ;
+  SVGContext ctx ;
+  ctx.os = &attrs ;
+  entry.style.writeSVG( ctx );
+  entry.attrs = attrs.str() ;
+
+  const StyleHandle h = StyleHandle( entries().size() );
+  assert( h != none );
+  entries().push_back( entry );
+  handles()[key] = h ;
+  return h ;
+}
+// -----------------------------------------------------------------------------
+
+const PathStyle & StyleTable::get( StyleHandle h )
+{
+  std::lock_guard<std::mutex> lock( mtx() );
+  assert( h < entries().size() );
+  return entries()[h].style ;
+}
+// -----------------------------------------------------------------------------
+
+const std::string & StyleTable::svgAttrs( StyleHandle h )
+{
+  std::lock_guard<std::mutex> lock( mtx() );
+  assert( h < entries().size() );
+  return entries()[h].attrs ;
+}
+// -----------------------------------------------------------------------------
+
+std::size_t StyleTable::size()
+{
+  std::lock_guard<std::mutex> lock( mtx() );
+  return entries().size() ;
+}
 
 // *****************************************************************************
 // class Object
@@ -221,12 +462,72 @@ void PathStyle::writeSVG( SVGContext & ctx )
 Object::Object()
 {
   projected = false ;
+  version   = 0 ;
+}
+// -----------------------------------------------------------------------------
+
+Object::Object( const Object & other )
+{
+  copyFrom( other );
+  version = 0 ;
+}
+// -----------------------------------------------------------------------------
+
+Object & Object::operator = ( const Object & other )
+{
+  copyFrom( other );
+  touch();
+  return *this ;
+}
+// -----------------------------------------------------------------------------
+
+void Object::copyFrom( const Object & other )
+{
+  projected = other.projected ;
+  min       = other.min ;
+  max       = other.max ;
+  check     = other.check ;
+}
+// -----------------------------------------------------------------------------
+
+void Object::touch()
+{
+  const bool was_projected = projected ;
+
+  version++ ;
+  projected = false ;
+  for( const auto & set_index : sets )
+    set_index.first->childChanged( set_index.second, was_projected );
+}
+// -----------------------------------------------------------------------------
+
+void Object::collectGradients( std::set<std::string> & names ) const
+{
+  // no gradients
+}
+// -----------------------------------------------------------------------------
+
+std::size_t Object::svgSizeEstimate() const
+{
+  return 256 ; // (a single small element)
 }
 // -----------------------------------------------------------------------------
 
 Object::~Object()
 {
+  // (a copy, as 'sets' may change meanwhile)
+  const std::vector< std::pair<ObjectsSet *,std::size_t> > sets_copy = sets ;
+  for( const auto & set_index : sets_copy )
+    set_index.first->childDestroyed( this, set_index.second );
+}
+// -----------------------------------------------------------------------------
 
+void Object::draw( DrawContext & ctx )
+{
+  if ( ctx.svg != nullptr )
+    drawSVG( *(ctx.svg) );
+  if ( ctx.sink != nullptr )
+    render( *(ctx.sink) );
 }
 
 // *****************************************************************************
@@ -238,6 +539,7 @@ Point::Point( vec3 ppos3D, vec3 pcolor )
   pos3D = ppos3D ;
   color = pcolor ;
   radius = 0.03 ;
+  style_handle = StyleTable::none ;
 }
 // -----------------------------------------------------------------------------
 
@@ -247,20 +549,47 @@ void Point::drawSVG( SVGContext & ctx )
   using namespace std ;
 
 
-  PathStyle e ;
-  e.draw_lines   = false ;
-  e.draw_filled  = true ;
-  e.fill_color   = color ;
-  e.fill_opacity = 1.0;
-
   assert( ctx.os != nullptr );
   std::ostream & os = *(ctx.os) ;
 
-  os << "<circle cx='" << pos2D[0] << "' cy='" << pos2D[1]
+  if ( ! check.ok() )  // (invalid projection)
+    return ;
+
+  SVGSizeMark from ;
+  if ( ctx.stats != nullptr )
+    from = ctx.stats->mark() ;
+
+  const std::string & attrs = StyleTable::svgAttrs( style_handle );
+  const vec2 pos = pos2D-ctx.offset ;
+  os << "<circle cx='" << pos[0] << "' cy='" << pos[1]
      <<       "' r='" << radius << "' " ;
-  e.writeSVG( ctx );
+  os << attrs ;
   os << "/>" << endl ;
 
+  if ( ctx.stats != nullptr )
+  {
+    ctx.stats->add( SVGBytes::Style, attrs.size() );
+    ctx.stats->add( SVGBytes::Circles, from );
+  }
+
+}
+// -----------------------------------------------------------------------------
+
+void Point::render( RenderSink & sink )
+{
+  assert( projected );
+
+  if ( check.ok() )
+    sink.fillCircle( pos2D, radius, color, 1.0 );
+}
+// -----------------------------------------------------------------------------
+
+void Point::hash( SceneHasher & h ) const
+{
+  h.add( "Point" );
+  h.add( pos3D );
+  h.add( color );
+  h.add( radius );
 }
 // -----------------------------------------------------------------------------
 
@@ -270,6 +599,16 @@ void Point::project( const Camera & cam )
   min       = pos2D ;
   max       = pos2D ;
   projected = true ;
+
+  check.reset();
+  check_vertex( pos2D, check );
+
+  PathStyle e ;
+  e.draw_lines   = false ;
+  e.draw_filled  = true ;
+  e.fill_color   = color ;
+  e.fill_opacity = 1.0;
+  style_handle = StyleTable::intern( e );
 }
 
 // *****************************************************************************
@@ -278,33 +617,169 @@ void Point::project( const Camera & cam )
 
 Polygon::Polygon()
 {
-
+  style_handle = StyleTable::none ;
 }
 // -----------------------------------------------------------------------------
 
-void Polygon::project( const Camera & cam )
+// project vertex 'i' (with 'Precision::Double', float64 data is not rounded to float)
+
+static inline vec2 project_vertex( const Camera & cam, const VertexArrayView & verts, std::size_t i )
 {
-  bool primero = true ;
-  points2D.clear() ;
+  if ( cam.precision == Precision::Double )
+    return cam.project( verts.at<double>( i ) );
+  return cam.project( verts[i] );
+}
+// -----------------------------------------------------------------------------
+// project vertexes in [begin,end) into 'out', accumulating their bounding box
+// in 'bmin' and 'bmax' (which must be initialized by the caller)
 
-  for( const vec3 & p3 : points3D )
+static void project_range( const Camera & cam, const VertexArrayView & verts,
+                           vec2 * out, std::size_t begin, std::size_t end,
+                           vec2 & bmin, vec2 & bmax )
+{
+  if ( cam.precision != Precision::Single )
   {
-    const vec2 p2 = cam.project( p3 );
-    if ( primero )
-    { min = p2 ;
-      max = p2 ;
-      primero = false ;
+    for( std::size_t i = begin ; i < end ; i++ )
+    {
+      const vec2 p2 = project_vertex( cam, verts, i );
+      bmin[0] = std::min( bmin[0], p2[0] );
+      bmin[1] = std::min( bmin[1], p2[1] );
+      bmax[0] = std::max( bmax[0], p2[0] );
+      bmax[1] = std::max( bmax[1], p2[1] );
+      out[i] = p2 ;
     }
-    else
-    { min[0] = std::min( min[0], p2[0] );
-      min[1] = std::min( min[1], p2[1] );
-      max[0] = std::max( max[0], p2[0] );
-      max[1] = std::max( max[1], p2[1] );
+    return ;
+  }
+
+  // single precision: vertexes are read (and mapped) in blocks, by the batch kernels
+  constexpr std::size_t block_size = 256 ;
+  vec3 block[block_size] ;
+  for( std::size_t first = begin ; first < end ; first += block_size )
+  {
+    const std::size_t n = std::min( block_size, end-first );
+    verts.readBlock( first, n, block );
+    for( std::size_t k = 0 ; k < n ; k++ )
+    {
+      const vec2 p2 = cam.project( block[k] );
+      bmin[0] = std::min( bmin[0], p2[0] );
+      bmin[1] = std::min( bmin[1], p2[1] );
+      bmax[0] = std::max( bmax[0], p2[0] );
+      bmax[1] = std::max( bmax[1], p2[1] );
+      out[first+k] = p2 ;
     }
-    points2D.push_back( p2 );
-    //using namespace std ;
-    //cout << "min ==" << min << ", max == " << max << endl ;
   }
+}
+// -----------------------------------------------------------------------------
+// project all the vertexes in 'verts' into 'out' (resized), and compute their
+// bounding box in 'bmin' and 'bmax' (large arrays are projected in parallel)
+
+static void project_vertexes( const Camera & cam, const VertexArrayView & verts,
+                              std::vector<vec2> & out, vec2 & bmin, vec2 & bmax )
+{
+  const std::size_t n = verts.size() ;
+
+  out.resize( n );
+  if ( n == 0 )
+    return ;
+
+  // the first vertex initializes the box, as the serial loop always did
+  bmin = project_vertex( cam, verts, 0 );
+  bmax = bmin ;
+
+  const std::size_t nc = parallel_num_chunks( n, Polygon::parallel_min_chunk );
+  if ( nc == 1 )  // small arrays: serial path, no threads involved
+  {
+    project_range( cam, verts, out.data(), 0, n, bmin, bmax );
+    return ;
+  }
+
+  // large arrays: each chunk computes its own box, then boxes are merged in
+  // chunk order. Chunk boxes start empty (+inf/-inf), so std::min/std::max give
+  // exactly the same values (NaN and signed zeros included) as the serial loop.
+  constexpr real inf = std::numeric_limits<real>::infinity() ;
+  std::vector<vec2> cmin( nc, vec2(  inf,  inf ) ),
+                    cmax( nc, vec2( -inf, -inf ) );
+  vec2 * pout = out.data() ;
+
+  parallel_for_chunks( n, Polygon::parallel_min_chunk,
+    [&]( std::size_t ic, std::size_t begin, std::size_t end )
+    {
+      project_range( cam, verts, pout, begin, end, cmin[ic], cmax[ic] );
+    });
+
+  for( std::size_t ic = 0 ; ic < nc ; ic++ )
+  {
+    bmin[0] = std::min( bmin[0], cmin[ic][0] );
+    bmin[1] = std::min( bmin[1], cmin[ic][1] );
+    bmax[0] = std::max( bmax[0], cmax[ic][0] );
+    bmax[1] = std::max( bmax[1], cmax[ic][1] );
+  }
+}
+// -----------------------------------------------------------------------------
+// bounding box of p[begin..end-1], added to 'bmin' and 'bmax'
+
+static void extend_box( const vec2 * p, std::size_t begin, std::size_t end,
+                        vec2 & bmin, vec2 & bmax )
+{
+  for( std::size_t i = begin ; i < end ; i++ )
+  {
+    bmin[0] = std::min( bmin[0], p[i][0] );
+    bmin[1] = std::min( bmin[1], p[i][1] );
+    bmax[0] = std::max( bmax[0], p[i][0] );
+    bmax[1] = std::max( bmax[1], p[i][1] );
+  }
+}
+// -----------------------------------------------------------------------------
+// an empty box (to be extended)
+
+static inline void empty_box( vec2 & bmin, vec2 & bmax )
+{
+  constexpr real inf = std::numeric_limits<real>::infinity() ;
+  bmin = vec2(  inf,  inf );
+  bmax = vec2( -inf, -inf );
+}
+// -----------------------------------------------------------------------------
+
+void Polygon::hash( SceneHasher & h ) const
+{
+  h.add( "Polygon" );
+  style.hash( h );
+
+  const VertexArrayView v = vertexes3D() ;
+  h.add( std::uint64_t( v.size() ) );
+  for( std::size_t i = 0 ; i < v.size() ; i++ )
+    h.add( v[i] );
+}
+// -----------------------------------------------------------------------------
+
+std::size_t Polygon::svgSizeEstimate() const
+{
+  // header and style, plus " L x y " for each vertex (6 significant digits)
+  return 256 + 24*points2D.size() ;
+}
+// -----------------------------------------------------------------------------
+
+void Polygon::collectGradients( std::set<std::string> & names ) const
+{
+  style.collectGradients( names );
+}
+// -----------------------------------------------------------------------------
+
+void Polygon::project( const Camera & cam )
+{
+  project_vertexes( cam, vertexes3D(), points2D, min, max );
+
+  // validation: invalid and repeated vertexes are removed (the box is computed
+  // again only when there were invalid ones)
+  check.reset();
+  points2D.resize( compact_vertexes( points2D.data(), points2D.size(), true, check ) );
+  if ( ! check.ok() )
+  {
+    empty_box( min, max );
+    extend_box( points2D.data(), 0, points2D.size(), min, max );
+  }
+
+  style_handle = StyleTable::intern( style );
   projected = true ;
 }
 
@@ -312,6 +787,12 @@ Polygon::~Polygon()
 {
 
 }
+// -----------------------------------------------------------------------------
+
+VertexArrayView Polygon::vertexes3D() const
+{
+  return VertexArrayView( points3D );
+}
 
 // -----------------------------------------------------------------------------
 
@@ -321,14 +802,14 @@ void Polygon::drawSVG( SVGContext & ctx )
    assert( ctx.os != nullptr );
 
 
-   if ( points3D.size() == 0 )
+   if ( points2D.size() == 0 )
    {
       cout << "WARNING: attempting to draw an empty Polygon object" << endl ;
       return ;
    }
 
   assert( projected );
-  assert( points3D.size() == points2D.size() );
+  assert( points2D.size() <= vertexes3D().size() );
 
   using namespace std ;
   std::ostream & os = *(ctx.os) ;
@@ -336,85 +817,518 @@ void Polygon::drawSVG( SVGContext & ctx )
   os << "<path " << endl
      << "   stroke-linecap='round' stroke-linejoin='round'" << endl ;
 
-  style.writeSVG( ctx );
+  const std::string & attrs = StyleTable::svgAttrs( style_handle );
+  os << attrs ;
 
-  os << "   d=' M " ;
-  write_coord2( os, points2D[0] );
+  os << "   d='" ;
+  SVGSizeMark d_from ;
+  if ( ctx.stats != nullptr )
+  {
+    ctx.stats->add( SVGBytes::Style, attrs.size() );
+    d_from = ctx.stats->mark() ;
+  }
+  os << " M " ;
+  write_coord2( os, points2D[0]-ctx.offset );
   for( unsigned i = 1 ; i < points2D.size() ; i++ )
   {
       os << " L " ;
-      write_coord2( os, points2D[i] );
+      write_coord2( os, points2D[i]-ctx.offset );
       os << " " ;
       //cout << points_proy[i] << endl ;
   }
   if ( style.close_lines )
     os << " Z" ;
+  if ( ctx.stats != nullptr )
+    ctx.stats->add( SVGBytes::PathData, d_from );
 
   os << "'/>" << endl;
 
 }
 
-// *****************************************************************************
-// class ConjuntoPuntos
 // -----------------------------------------------------------------------------
 
-ObjectsSet::ObjectsSet()
+void Polygon::render( RenderSink & sink )
 {
+  if ( points2D.size() == 0 )
+    return ;
+  assert( projected );
 
-}
-
-ObjectsSet::~ObjectsSet()
-{
+  // converted once, shared by all the sinks
+  const std::vector<Vec2f> pts( points2D.begin(), points2D.end() );
 
+  if ( style.draw_filled )
+  {
+    if ( style.use_grad_fill )
+      sink.fillPolygonGradient( pts, GradientRegistry::get( style.grad_fill_name ),
+                                min, max-min, style.fill_opacity );
+    else
+      sink.fillPolygon( pts, style.fill_color, style.fill_opacity );
+  }
+  if ( style.draw_lines )
+    sink.strokePolyline( pts, style.close_lines, style.lines_width,
+                         style.dashed_lines ? 0.01f : 0.0f, style.lines_color );
 }
+
+// *****************************************************************************
+// class PointCloud
 // -----------------------------------------------------------------------------
 
-void ObjectsSet::add( Object * pobj )
+PointCloud::PointCloud()
 {
-  objetos.push_back( pobj );
   projected = false ;
 }
-
 // -----------------------------------------------------------------------------
 
-void ObjectsSet::project( const Camera & cam )
+void PointCloud::reserve( std::size_t n )
 {
-   bool primero = true ;
+  positions3D.reserve( n );
+  colors.reserve( n );
+  radii.reserve( n );
+}
+// -----------------------------------------------------------------------------
 
-   for( Object * pobjeto : objetos )
-   {
-      assert( pobjeto != nullptr );
-      pobjeto->project( cam );
+void PointCloud::add( const vec3 & pos, const vec3 & color, real radius )
+{
+  positions3D.push_back( pos );
+  colors.push_back( color );
+  radii.push_back( radius );
+  touch();
+}
+// -----------------------------------------------------------------------------
 
-      if ( primero )
-      {
-         min = pobjeto->min ;
-         max = pobjeto->max ;
-         primero = false ;
+std::size_t PointCloud::svgSizeEstimate() const
+{
+  // a path for each run, plus two arcs for each point
+  return 120*run_first.size() + 40*positions2D.size() ;
+}
+// -----------------------------------------------------------------------------
+
+void PointCloud::project( const Camera & cam )
+{
+  project_vertexes( cam, VertexArrayView( positions3D ), positions2D, min, max );
+
+  // runs of consecutive valid points with the same color, and their styles
+  // (invalid points end a run, so they are never drawn)
+  check.reset();
+  run_first.clear();
+  run_end.clear();
+  run_styles.clear();
+
+  const std::size_t n = size() ;
+  for( std::size_t begin = 0 ; begin < n ; )
+  {
+    const std::size_t end = begin + first_invalid( positions2D.data()+begin, n-begin, false );
+    check.checked += end-begin ;
+
+    for( std::size_t i = begin ; i < end ; i++ )
+    {
+      if ( i > begin && colors[i][0] == colors[i-1][0] && colors[i][1] == colors[i-1][1] &&
+                        colors[i][2] == colors[i-1][2] )
+        continue ;
+      if ( i > begin )
+        run_end.push_back( i );
+
+      PathStyle e ;
+      e.draw_lines   = false ;
+      e.draw_filled  = true ;
+      e.fill_color   = colors[i] ;
+      e.fill_opacity = 1.0;
+      run_first.push_back( i );
+      run_styles.push_back( StyleTable::intern( e ) );
+    }
+    if ( begin < end )
+      run_end.push_back( end );
+
+    if ( end < n )
+      check_vertex( positions2D[end], check ); // (invalid)
+    begin = end+1 ;
+  }
+
+  if ( ! check.ok() )
+  {
+    empty_box( min, max );
+    for( std::size_t ir = 0 ; ir < run_first.size() ; ir++ )
+      extend_box( positions2D.data(), run_first[ir], run_end[ir], min, max );
+  }
+  projected = true ;
+}
+// -----------------------------------------------------------------------------
+
+void PointCloud::hash( SceneHasher & h ) const
+{
+  h.add( "PointCloud" );
+  h.add( std::uint64_t( size() ) );
+  for( std::size_t i = 0 ; i < size() ; i++ )
+  {
+    h.add( positions3D[i] );
+    h.add( colors[i] );
+    h.add( radii[i] );
+  }
+}
+// -----------------------------------------------------------------------------
+
+void PointCloud::drawSVG( SVGContext & ctx )
+{
+  using namespace std ;
+  assert( ctx.os != nullptr );
+
+  if ( size() == 0 )
+  {
+    cout << "WARNING: attempting to draw an empty PointCloud object" << endl ;
+    return ;
+  }
+  assert( projected );
+  assert( positions2D.size() == size() );
+
+  std::ostream & os = *(ctx.os) ;
+
+  for( std::size_t ir = 0 ; ir < run_first.size() ; ir++ )
+  {
+    const std::string & attrs = StyleTable::svgAttrs( run_styles[ir] );
+    os << "<path" << endl
+       << attrs ;
+    os << "   d='" ;
+    SVGSizeMark d_from ;
+    if ( ctx.stats != nullptr )
+    {
+      ctx.stats->add( SVGBytes::Style, attrs.size() );
+      d_from = ctx.stats->mark() ;
+    }
+    for( std::size_t i = run_first[ir] ; i < run_end[ir] ; i++ )
+    {
+      // a circle as two half circles, from the leftmost point
+      const vec2 pos = positions2D[i]-ctx.offset ;
+      const real r   = radii[i] ;
+      os << "M" << pos[0]-r << " " << pos[1]
+         << "a" << r << " " << r << " 0 1 0 " << 2*r << " 0"
+         << "a" << r << " " << r << " 0 1 0 " << -2*r << " 0" ;
+    }
+    if ( ctx.stats != nullptr )
+      ctx.stats->add( SVGBytes::PathData, d_from );
+    os << "'/>" << endl ;
+  }
+}
+// -----------------------------------------------------------------------------
+
+void PointCloud::render( RenderSink & sink )
+{
+  assert( projected || size() == 0 );
+
+  for( std::size_t ir = 0 ; ir < run_first.size() ; ir++ )
+    for( std::size_t i = run_first[ir] ; i < run_end[ir] ; i++ )
+      sink.fillCircle( positions2D[i], radii[i], colors[i], 1.0 );
+}
+
+// *****************************************************************************
+// class MappedPolygon
+// -----------------------------------------------------------------------------
+
+MappedPolygon::MappedPolygon( const std::string & path, VertexFormat p_format )
+
+: file( path )
+{
+  format = p_format ;
+
+  const std::size_t vert_size = 3*( format == VertexFormat::Float32 ? sizeof(float) : sizeof(double) );
+  if ( file.size() % vert_size != 0 )
+    throw std::runtime_error( "size of vertex file '" + path + "' is not a multiple of the vertex size" );
+}
+// -----------------------------------------------------------------------------
+
+VertexArrayView MappedPolygon::vertexes3D() const
+{
+  const std::size_t vert_size = 3*( format == VertexFormat::Float32 ? sizeof(float) : sizeof(double) );
+  return VertexArrayView( file.data(), file.size()/vert_size, format );
+}
+
+// *****************************************************************************
+// class ConjuntoPuntos
+// -----------------------------------------------------------------------------
+
+ObjectsSet::ObjectsSet()
+{
+  camera_valid = false ;
+  camera_key   = 0 ;
+  num_added    = 0 ;
+}
+
+ObjectsSet::~ObjectsSet()
+{
+  // children are not owned, but they must forget this set
+  for( Object * pobjeto : objetos )
+  {
+    assert( pobjeto != nullptr );
+    auto & s = pobjeto->sets ;
+    s.erase( std::remove_if( s.begin(), s.end(),
+                             [this]( const std::pair<ObjectsSet *,std::size_t> & set_index )
+                             { return set_index.first == this ; } ),
+             s.end() );
+  }
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::add( Object * pobj )
+{
+  assert( pobj != nullptr );
+  const std::size_t i = objetos.size() ;
+
+  objetos.push_back( pobj );
+  pobj->sets.push_back( std::make_pair( this, i ) );
+  num_added++ ;
+  dirty.push_back( i );
+  touch();
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::childChanged( std::size_t i, bool was_projected )
+{
+  // (a child not projected is already in 'dirty')
+  if ( was_projected )
+    dirty.push_back( i );
+  touch();
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::childDestroyed( Object * pobj, std::size_t i )
+{
+  // the child is removed, and the indexes of the following ones updated (the
+  // whole set is projected again next time)
+  if ( i < objetos.size() && objetos[i] == pobj )
+  {
+    objetos.erase( objetos.begin()+i );
+    num_added-- ;
+    for( std::size_t j = i ; j < objetos.size() ; j++ )
+      for( auto & set_index : objetos[j]->sets )
+        if ( set_index.first == this && set_index.second == j+1 )
+          set_index.second = j ;
+  }
+  camera_valid = false ;
+  touch();
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::hash( SceneHasher & h ) const
+{
+  h.add( "ObjectsSet" );
+  h.add( std::uint64_t( objetos.size() ) );
+  for( const Object * pobjeto : objetos )
+  {
+    assert( pobjeto != nullptr );
+    pobjeto->hash( h );
+  }
+}
+// -----------------------------------------------------------------------------
+
+std::size_t ObjectsSet::svgSizeEstimate() const
+{
+  std::size_t sum = 0 ;
+  for( const Object * pobjeto : objetos )
+  {
+    assert( pobjeto != nullptr );
+    sum += pobjeto->svgSizeEstimate() ;
+  }
+  return sum ;
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::collectGradients( std::set<std::string> & names ) const
+{
+  for( const Object * pobjeto : objetos )
+  {
+    assert( pobjeto != nullptr );
+    pobjeto->collectGradients( names );
+  }
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::project( const Camera & cam )
+{
+   const std::size_t n = objetos.size() ;
+
+   // all the children are projected with a new camera, or when 'objetos' has
+   // been changed without 'add'; else just those changed (or added)
+   SceneHasher cam_hash ;
+   cam.hash( cam_hash );
+   const bool all = ! camera_valid || camera_key != cam_hash.value() || num_added != n ;
+
+   if ( all )
+   {
+      dirty.resize( n );
+      for( std::size_t i = 0 ; i < n ; i++ )
+         dirty[i] = i ;
    }
    else
    {
-      min[0] = std::min( min[0], pobjeto->min[0] );
-      min[1] = std::min( min[1], pobjeto->min[1] );
-      max[0] = std::max( max[0], pobjeto->max[0] );
-      max[1] = std::max( max[1], pobjeto->max[1] );
+      std::sort( dirty.begin(), dirty.end() );
+      dirty.erase( std::unique( dirty.begin(), dirty.end() ), dirty.end() );
    }
-   //using namespace std ;
-   //cout << "min ==" << min << ", max == " << max << endl ;
-  }
-  projected = true ;
+
+   // children are projected in parallel (when there are enough of them) ...
+   parallel_for_chunks( dirty.size(), parallel_min_chunk,
+     [&]( std::size_t ic, std::size_t begin, std::size_t end )
+     {
+        for( std::size_t k = begin ; k < end ; k++ )
+        {
+           assert( dirty[k] < n && objetos[dirty[k]] != nullptr );
+           objetos[dirty[k]]->project( cam );
+        }
+     });
+
+   // ... the boxes of the chunks with projected children are merged again ...
+   const std::size_t nc = (n+bounds_chunk-1)/bounds_chunk ;
+   std::vector<bool> chunk_dirty( nc, all );
+   for( std::size_t i : dirty )
+      chunk_dirty[i/bounds_chunk] = true ;
+   chunk_min.resize( nc );
+   chunk_max.resize( nc );
+
+   for( std::size_t ic = 0 ; ic < nc ; ic++ )
+   {
+      if ( ! chunk_dirty[ic] )
+         continue ;
+      empty_box( chunk_min[ic], chunk_max[ic] );
+      for( std::size_t i = ic*bounds_chunk ; i < std::min( n, (ic+1)*bounds_chunk ) ; i++ )
+      {
+         extend_box( &(objetos[i]->min), 0, 1, chunk_min[ic], chunk_max[ic] );
+         extend_box( &(objetos[i]->max), 0, 1, chunk_min[ic], chunk_max[ic] );
+      }
+   }
+
+   // ... and then the boxes of all the chunks
+   empty_box( min, max );
+   extend_box( chunk_min.data(), 0, nc, min, max );
+   extend_box( chunk_max.data(), 0, nc, min, max );
+
+   // one summary line for each child projected with invalid vertexes
+   for( std::size_t i : dirty )
+      if ( ! objetos[i]->check.ok() )
+         objetos[i]->check.report( std::cout, "object " + std::to_string( i ) +
+                                   " (of " + std::to_string( n ) + ")" );
+
+   dirty.clear();
+   camera_valid = true ;
+   camera_key   = cam_hash.value() ;
+   projected    = true ;
+}
+
+// -----------------------------------------------------------------------------
+// name of the type of an object, as written in reports
+
+static std::string type_name( const Object & obj )
+{
+  const char * mangled = typeid( obj ).name() ;
+  int    status = 0 ;
+  char * name   = abi::__cxa_demangle( mangled, nullptr, nullptr, &status );
+  const std::string res = ( status == 0 && name != nullptr ) ? name : mangled ;
+  std::free( name );
+  return res ;
 }
+// -----------------------------------------------------------------------------
+// write a child (or a <use> of it) with its bytes accounted in 'ctx.stats'
+
+static void draw_child_svg_counted( Object * obj, SVGContext & ctx )
+{
+  assert( ctx.stats != nullptr );
+  const SVGSizeMark from = ctx.stats->mark() ;
+
+  if ( ctx.defs != nullptr && ctx.defs->writeUse( obj, *(ctx.os) ) )
+    ctx.stats->add( SVGBytes::Use, from );
+  else
+    obj->drawSVG( ctx );
 
+  ctx.stats->addObject( type_name( *obj ), from );
+}
 // -----------------------------------------------------------------------------
 
 void ObjectsSet::drawSVG( SVGContext & ctx )
 {
+  if ( ctx.stats != nullptr ) // accounting: serial, as the positions in the stream are used
+  {
+    for( Object * pobjeto : objetos )
+    {
+      assert( pobjeto != nullptr );
+      draw_child_svg_counted( pobjeto, ctx );
+    }
+    return ;
+  }
+
+  const std::size_t nc = parallel_num_chunks( objetos.size(), parallel_min_chunk );
+
+  if ( nc == 1 ) // serial: write straight to the output stream
+  {
+    for( Object * pobjeto : objetos )
+    {
+      assert( pobjeto != nullptr );
+      if ( ctx.defs == nullptr || ! ctx.defs->writeUse( pobjeto, *(ctx.os) ) )
+        pobjeto->drawSVG( ctx );
+    }
+    return ;
+  }
+
+  // parallel: each chunk of children is written to its own buffer (with the same
+  // format flags as the output stream), then buffers are appended in order, so the
+  // output is byte-identical to the serial one
+  assert( ctx.os != nullptr );
+  std::vector<std::ostringstream> buffers( nc );
+
+  parallel_for_chunks( objetos.size(), parallel_min_chunk,
+    [&]( std::size_t ic, std::size_t begin, std::size_t end )
+    {
+      SVGContext chunk_ctx = ctx ;
+      buffers[ic].copyfmt( *(ctx.os) );
+      chunk_ctx.os = &(buffers[ic]) ;
+
+      for( std::size_t i = begin ; i < end ; i++ )
+      {
+        assert( objetos[i] != nullptr );
+        if ( ctx.defs == nullptr || ! ctx.defs->writeUse( objetos[i], *(chunk_ctx.os) ) )
+          objetos[i]->drawSVG( chunk_ctx );
+      }
+    });
+
+  for( std::ostringstream & buffer : buffers )
+  {
+    const std::string & str = buffer.str() ;
+    ctx.os->write( str.data(), str.size() );
+  }
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::render( RenderSink & sink )
+{
+  for( Object * pobjeto : objetos )
+  {
+    assert( pobjeto != nullptr );
+    pobjeto->render( sink );
+  }
+}
+// -----------------------------------------------------------------------------
+
+void ObjectsSet::draw( DrawContext & ctx )
+{
+  // SVG only: children are written in parallel (see 'drawSVG')
+  if ( ctx.sink == nullptr )
+  {
+    if ( ctx.svg != nullptr )
+      drawSVG( *(ctx.svg) );
+    return ;
+  }
   for( Object * pobjeto : objetos )
   {
     assert( pobjeto != nullptr );
-    pobjeto->drawSVG( ctx );
+    if ( ctx.svg != nullptr && ctx.svg->stats != nullptr )
+    {
+      draw_child_svg_counted( pobjeto, *(ctx.svg) );
+      pobjeto->render( *(ctx.sink) );
+    }
+    else if ( ctx.svg != nullptr && ctx.svg->defs != nullptr &&
+         ctx.svg->defs->writeUse( pobjeto, *(ctx.svg->os) ) )
+      pobjeto->render( *(ctx.sink) ); // (the SVG has been written as a <use>)
+    else
+      pobjeto->draw( ctx );
   }
 }
+
 // *****************************************************************************
 // class Sphere : public Object
 // -----------------------------------------------------------------------------
@@ -423,6 +1337,22 @@ Sphere::Sphere( const vec3 & pcenter3D, real pradius3D )
 {
   radius3D = pradius3D ;
   center3D = pcenter3D ;
+  grad_fill_name = "sphereGradFill" ;
+}
+// -----------------------------------------------------------------------------
+
+void Sphere::hash( SceneHasher & h ) const
+{
+  h.add( "Sphere" );
+  h.add( center3D );
+  h.add( radius3D );
+  GradientRegistry::hash( h, grad_fill_name );
+}
+// -----------------------------------------------------------------------------
+
+void Sphere::collectGradients( std::set<std::string> & names ) const
+{
+  names.insert( grad_fill_name );
 }
 // -----------------------------------------------------------------------------
 
@@ -446,12 +1376,89 @@ void Sphere::drawSVG( SVGContext & ctx )
   using namespace std ;
   std::ostream & os = *(ctx.os) ;
 
-  write_radial_gradient_def( os, "grad1" );
+  SVGSizeMark from ;
+  if ( ctx.stats != nullptr )
+    from = ctx.stats->mark() ;
 
+  const vec2 center = center2D-ctx.offset ;
   os << "<circle " << endl
-     << "   style='fill:url(#grad1); stroke:black; stroke-width:0.003'" << endl
-     << "   cx='" << center2D[0] <<  "' cy='" << center2D[1] << "' r='" << radius2D << "'" << endl
+     << "   style='fill:url(#" << grad_fill_name << "); stroke:black; stroke-width:0.003'" << endl
+     << "   cx='" << center[0] <<  "' cy='" << center[1] << "' r='" << radius2D << "'" << endl
      << "/>" << endl ;
+
+  if ( ctx.stats != nullptr )
+    ctx.stats->add( SVGBytes::Circles, from );
+}
+
+// -----------------------------------------------------------------------------
+
+void Sphere::render( RenderSink & sink )
+{
+  assert( projected );
+
+  sink.fillCircleGradient( center2D, radius2D, GradientRegistry::get( grad_fill_name ), 1.0 );
+  sink.strokeCircle( center2D, radius2D, 0.003, vec3( 0.0, 0.0, 0.0 ) );
+}
+
+// *****************************************************************************
+// class PrerenderedObject : public Object
+// -----------------------------------------------------------------------------
+
+PrerenderedObject::PrerenderedObject( Object * p_obj, const Camera & cam )
+{
+  assert( p_obj != nullptr );
+  obj = p_obj ;
+  obj->project( cam );
+
+  std::ostringstream os ;
+  SVGContext ctx ;
+  ctx.os = &os ;
+  obj->drawSVG( ctx );
+  svg_text = os.str() ;
+
+  projected = true ;
+  min = obj->min ;
+  max = obj->max ;
+}
+// -----------------------------------------------------------------------------
+
+void PrerenderedObject::project( const Camera & cam )
+{
+  // already projected (with the camera given to the constructor)
+}
+// -----------------------------------------------------------------------------
+
+void PrerenderedObject::drawSVG( SVGContext & ctx )
+{
+  // (the cached text has no offset, and its bytes cannot be accounted by kind)
+  if ( ctx.offset[0] != 0.0 || ctx.offset[1] != 0.0 || ctx.stats != nullptr )
+    obj->drawSVG( ctx );
+  else
+    ctx.os->write( svg_text.data(), svg_text.size() );
+}
+// -----------------------------------------------------------------------------
+
+void PrerenderedObject::render( RenderSink & sink )
+{
+  obj->render( sink );
+}
+// -----------------------------------------------------------------------------
+
+void PrerenderedObject::hash( SceneHasher & h ) const
+{
+  obj->hash( h );
+}
+// -----------------------------------------------------------------------------
+
+std::size_t PrerenderedObject::svgSizeEstimate() const
+{
+  return svg_text.size() ;
+}
+// -----------------------------------------------------------------------------
+
+void PrerenderedObject::collectGradients( std::set<std::string> & names ) const
+{
+  obj->collectGradients( names );
 }
 
 // *****************************************************************************
@@ -474,25 +1481,20 @@ Hemisphere::Hemisphere( const vec3 & pcenter3D, real pradius3D, vec3 p_view_dir,
 
       auto * contour = new Polygon();
 
-    // add points in the equator
+    // add points in the equator (angles pi*i/np, that is, 2*pi*i/(2*np))
     const int np = 128 ;
+    const UnitCircle circle( 2*np );
 
     // semicircunference (front side of the equator) (perp. to Y)
     for( int i = 0 ; i < np ; i++ )
-    {
-       const float angr = M_PI*float(i)/float(np);
-       contour->points3D.push_back( center3D + radius3D*( -cos(angr)*axisx + sin(angr)*axisz )  );
-    }
+       contour->points3D.push_back( center3D + radius3D*( -circle.cos(i)*axisx + circle.sin(i)*axisz )  );
 
     // semicircunference perp. to Z
     const vec3
       axisy_rot = axisx.cross( view_dir_norm ).normalized(); // axisY, but perp. to view dir
 
     for( int i = 0 ; i < np ; i++ )
-    {
-       const float angr = M_PI*float(i)/float(np);
-       contour->points3D.push_back( center3D + radius3D*(cos(angr)*axisx + sin(angr)*axisy_rot)  );
-    }
+       contour->points3D.push_back( center3D + radius3D*(circle.cos(i)*axisx + circle.sin(i)*axisy_rot)  );
 
     contour->style.draw_filled = true ;
     contour->style.use_grad_fill = true ;
@@ -510,10 +1512,7 @@ Hemisphere::Hemisphere( const vec3 & pcenter3D, real pradius3D, vec3 p_view_dir,
 
    // semicircunference at the equator (perp. to view_dir) (equalt to contour equator)
    for( int i = 0 ; i <= np ; i++ )
-   {
-      const float angr = M_PI*float(i)/float(np);
-      equator->points3D.push_back( center3D + radius3D*( -cos(angr)*axisx - sin(angr)*axisz )  );
-   }
+      equator->points3D.push_back( center3D + radius3D*( -circle.cos(i)*axisx - circle.sin(i)*axisz )  );
 
    equator->style.draw_filled = false ;
    equator->style.draw_lines  = true ;
@@ -575,21 +1574,189 @@ Segment::Segment( const Point & p0, const Point & p1, real width )
 }
 
 // *****************************************************************************
-// class Ellipse
-// an arbitrary ellipse, at any point, with any orientation
+// class SegmentBatch
+// -----------------------------------------------------------------------------
 
-Ellipse::Ellipse( unsigned n, const vec3 & center, const vec3 & eje1, const vec3 eje2 )
+SegmentBatch::SegmentBatch()
 {
-  for( unsigned i= 0 ; i < n ; i++ )
-  {
-    const real ang = real(i)*real(2.0)*real(M_PI)/real(n) ,
-               c   = cos(double(ang)),
-               s   = sin(double(ang));
+  projected = false ;
+}
+// -----------------------------------------------------------------------------
 
-    points3D.push_back( center + c*eje1 + s*eje2 ) ;
-  }
-  style.draw_filled = false ;
-  style.draw_lines  = true ;
+unsigned SegmentBatch::addStyle( const vec3 & color, real width )
+{
+  PathStyle style ;
+  style.draw_lines   = true ;
+  style.draw_filled  = false ;
+  style.close_lines  = false ;
+  style.lines_color  = color ;
+  style.lines_width  = width ;
+
+  styles.push_back( style );
+  return styles.size()-1 ;
+}
+// -----------------------------------------------------------------------------
+
+void SegmentBatch::add( const vec3 & p0, const vec3 & p1, unsigned istyle )
+{
+  assert( istyle < styles.size() );
+  ends3D.push_back( p0 );
+  ends3D.push_back( p1 );
+  style_index.push_back( istyle );
+  touch();
+}
+// -----------------------------------------------------------------------------
+
+void SegmentBatch::project( const Camera & cam )
+{
+  project_vertexes( cam, VertexArrayView( ends3D ), ends2D, min, max );
+
+  // validation: segments with an invalid endpoint are left out (found with
+  // 'first_invalid', restarted after each invalid endpoint)
+  const std::size_t ns = numSegments() ;
+  std::vector<bool> valid( ns, true );
+  check.reset();
+  for( std::size_t begin = 0 ; begin < 2*ns ; )
+  {
+    const std::size_t end = begin + first_invalid( ends2D.data()+begin, 2*ns-begin, false );
+    check.checked += end-begin ;
+    if ( end < 2*ns )
+    {
+      check_vertex( ends2D[end], check );
+      valid[end/2] = false ;
+    }
+    begin = end+1 ;
+  }
+
+  // drawing order: valid segments grouped by style (a counting sort)
+  style_first.assign( styles.size()+1, 0 );
+  for( std::size_t i = 0 ; i < ns ; i++ )
+    if ( valid[i] )
+      style_first[style_index[i]+1]++ ;
+  for( unsigned is = 0 ; is < styles.size() ; is++ )
+    style_first[is+1] += style_first[is] ;
+
+  draw_order.resize( style_first[styles.size()] );
+  std::vector<std::size_t> next( style_first.begin(), style_first.end()-1 );
+  for( std::size_t i = 0 ; i < ns ; i++ )
+    if ( valid[i] )
+      draw_order[next[style_index[i]]++] = i ;
+
+  if ( ! check.ok() )
+  {
+    empty_box( min, max );
+    for( std::size_t i : draw_order )
+      extend_box( ends2D.data(), 2*i, 2*i+2, min, max );
+  }
+
+  style_handles.resize( styles.size() );
+  for( unsigned is = 0 ; is < styles.size() ; is++ )
+    style_handles[is] = StyleTable::intern( styles[is] );
+  projected = true ;
+}
+// -----------------------------------------------------------------------------
+
+void SegmentBatch::hash( SceneHasher & h ) const
+{
+  h.add( "SegmentBatch" );
+  h.add( std::uint64_t( styles.size() ) );
+  for( const PathStyle & style : styles )
+    style.hash( h );
+
+  h.add( std::uint64_t( numSegments() ) );
+  for( std::size_t i = 0 ; i < numSegments() ; i++ )
+  {
+    h.add( std::uint64_t( style_index[i] ) );
+    h.add( ends3D[2*i] );
+    h.add( ends3D[2*i+1] );
+  }
+}
+// -----------------------------------------------------------------------------
+
+std::size_t SegmentBatch::svgSizeEstimate() const
+{
+  // a path for each style, plus " M x y L x y" for each segment
+  return 256*styles.size() + 44*numSegments() ;
+}
+// -----------------------------------------------------------------------------
+
+void SegmentBatch::drawSVG( SVGContext & ctx )
+{
+  using namespace std ;
+  assert( ctx.os != nullptr );
+
+  if ( numSegments() == 0 )
+  {
+    cout << "WARNING: attempting to draw an empty SegmentBatch object" << endl ;
+    return ;
+  }
+  assert( projected );
+  assert( ends2D.size() == ends3D.size() );
+
+  std::ostream & os = *(ctx.os) ;
+
+  for( unsigned is = 0 ; is < styles.size() ; is++ )
+  {
+    if ( style_first[is] == style_first[is+1] )
+      continue ;
+
+    os << "<path " << endl
+       << "   stroke-linecap='round' stroke-linejoin='round'" << endl ;
+    const std::string & attrs = StyleTable::svgAttrs( style_handles[is] );
+    os << attrs ;
+    os << "   d='" ;
+    SVGSizeMark d_from ;
+    if ( ctx.stats != nullptr )
+    {
+      ctx.stats->add( SVGBytes::Style, attrs.size() );
+      d_from = ctx.stats->mark() ;
+    }
+    for( std::size_t k = style_first[is] ; k < style_first[is+1] ; k++ )
+    {
+      const std::size_t i = draw_order[k] ;
+      os << " M " ;
+      write_coord2( os, ends2D[2*i]-ctx.offset );
+      os << " L " ;
+      write_coord2( os, ends2D[2*i+1]-ctx.offset );
+    }
+    if ( ctx.stats != nullptr )
+      ctx.stats->add( SVGBytes::PathData, d_from );
+    os << "'/>" << endl ;
+  }
+}
+// -----------------------------------------------------------------------------
+
+void SegmentBatch::render( RenderSink & sink )
+{
+  assert( projected || numSegments() == 0 );
+
+  // same order as the SVG output: grouped by style
+  std::vector<Vec2f> pts( 2 );
+  for( unsigned is = 0 ; is < styles.size() ; is++ )
+  {
+    const PathStyle & style = styles[is] ;
+    for( std::size_t k = style_first[is] ; k < style_first[is+1] ; k++ )
+    {
+      const std::size_t i = draw_order[k] ;
+      pts[0] = ends2D[2*i] ;
+      pts[1] = ends2D[2*i+1] ;
+      sink.strokePolyline( pts, false, style.lines_width,
+                           style.dashed_lines ? 0.01f : 0.0f, style.lines_color );
+    }
+  }
+}
+
+// *****************************************************************************
+// class Ellipse
+// an arbitrary ellipse, at any point, with any orientation
+
+Ellipse::Ellipse( unsigned n, const vec3 & center, const vec3 & eje1, const vec3 eje2 )
+{
+  const UnitCircle circle( n ); // (tabulated for the usual counts, no trigonometric calls)
+  for( unsigned i= 0 ; i < n ; i++ )
+    points3D.push_back( center + circle.cos(i)*eje1 + circle.sin(i)*eje2 ) ;
+  style.draw_filled = false ;
+  style.draw_lines  = true ;
   style.close_lines = true ;
   style.lines_width = 0.006 ;
   style.lines_color = vec3( 0.0, 1.0, 0.0 );
@@ -734,250 +1901,898 @@ PolQuad::PolQuad( const vec3 & p00, const vec3 & p01, const vec3 & p10, const ve
   points3D.push_back( p11 );
   points3D.push_back( p10 );
 
-  style.draw_lines    = false ;
-  style.close_lines = false ;
-  style.draw_filled     = true ;
-  style.fill_opacity = 0.2 ;
-  style.fill_color    = vec3( 1.0, 0.0, 0.0 );
+  style.draw_lines    = false ;
+  style.close_lines = false ;
+  style.draw_filled     = true ;
+  style.fill_opacity = 0.2 ;
+  style.fill_color    = vec3( 1.0, 0.0, 0.0 );
+}
+
+// *****************************************************************************
+// class SegmentsVert
+// -----------------------------------------------------------------------------
+
+SegmentsVert::SegmentsVert( unsigned dn, const Polygon & p1, const Polygon & p2 )
+{
+  const VertexArrayView v1 = p1.vertexes3D(),
+                        v2 = p2.vertexes3D();
+  const int n = v1.size() ;
+  assert( n == v2.size() );
+
+  const vec3 color = vec3( 0.0, 0.7, 1.0 );
+  constexpr real width =  0.0025 ;
+
+  const unsigned istyle = addStyle( color, width );
+  ends3D.reserve( 2*((n+dn-1)/dn) );
+
+  for( unsigned i = 0 ; i < n ; i += dn )
+      add( v1[i], v2[i], istyle );
+}
+
+// *****************************************************************************
+// class Axes
+// -----------------------------------------------------------------------------
+
+Axes::Axes( real widthl, bool flip   )  // widthl = width de línea
+{
+  vec3 o = vec3(0.0,0.0,0.0);
+
+  if ( flip )  // draw X and Y in the horizontal plane
+  {
+    add( o, vec3(1.0,0.0,0.0),  addStyle( vec3(1.0,0.7,0.7), widthl ) );
+    add( o, vec3(0.0,0.0,-1.0), addStyle( vec3(0.6,0.7,0.6), widthl ) );
+    add( o, vec3(0.0,1.0,0.0),  addStyle( vec3(0.7,0.7,1.0), widthl ) );
+  }
+  else
+  {
+    add( o, vec3(1.0,0.0,0.0), addStyle( vec3(1.0,0.0,0.0), widthl ) );
+    add( o, vec3(0.0,1.0,0.0), addStyle( vec3(0.0,0.5,0.0), widthl ) );
+    add( o, vec3(0.0,0.0,1.0), addStyle( vec3(0.0,0.0,1.0), widthl ) );
+  }
+}
+
+// *****************************************************************************
+// class YAxisProjectorsSegments
+// -----------------------------------------------------------------------------
+
+YAxisProjectorsSegments::YAxisProjectorsSegments( unsigned dn, const Polygon & p1 )
+{
+  const VertexArrayView v1 = p1.vertexes3D();
+  const int n = v1.size() ;
+  assert( 0 < n );
+  const vec3 color = vec3( 0.0, 0.7, 1.0 );
+  constexpr real width =  0.0025 ;
+
+  const unsigned istyle = addStyle( color, width );
+  ends3D.reserve( 2*((n+dn-1)/dn) );
+
+  for( unsigned i = 0 ; i < n ; i += dn )
+  {
+      const vec3 pesf = v1[i] ,
+                 pyAxis = vec3(0.0,pesf[1],0.0);
+
+      add( pyAxis, pesf, istyle );
+  }
+}
+// *****************************************************************************
+// class YAxisCylinder
+// -----------------------------------------------------------------------------
+
+YAxisCylinder::YAxisCylinder( const Camera & cam )
+{
+
+  // circunferencia inferior
+  Ellipse * pcinf = new Ellipse( 64, vec3(0.0,-1.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,0.0,1.0));
+  pcinf->style.draw_filled = false ;
+  pcinf->style.lines_color = vec3(1.0,0.0,0.0) ;
+
+  // circunferencia ecuador
+  Ellipse * pcecu = new Ellipse( 64, vec3(0.0,0.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,0.0,1.0));
+  pcecu->style.draw_filled = false ;
+  pcecu->style.close_lines = true ;
+  pcecu->style.lines_color = vec3(0.4,0.4,0.4) ;
+  pcecu->style.lines_width = 0.002 ;
+
+  // circunferencia superior
+  Ellipse * pcsup = new Ellipse( 64, vec3(0.0,1.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,0.0,1.0));
+  pcsup->style.draw_filled = false ;
+  pcsup->style.lines_color = vec3(1.0,0.0,0.0) ;
+
+  // segmentos verticales que delimitan el cilindro
+  const vec3 v  = cam.src.zAxis.normalized() ;
+  const real s  = sqrt(v[0]*v[0]+v[2]*v[2]);
+  const vec3 n1 = vec3(  v[2]/s, -1.0, -v[0]/s ),
+             n2 = vec3( -v[2]/s, -1.0,  v[0]/s );
+  Segment
+    * s1 = new Segment( n1, vec3(0.0,2.0,0.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width ),
+    * s2 = new Segment( n2, vec3(0.0,2.0,0.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width );
+
+    add( pcinf );
+    add( pcecu );
+    add( pcsup );
+    add( s1 );
+    add( s2 );
+}
+
+// *****************************************************************************
+// class ZAxisCylinder
+// -----------------------------------------------------------------------------
+
+ZAxisCylinder::ZAxisCylinder( const Camera & cam )
+{
+
+  // circunferencia inferior
+  Ellipse * pcinf = new Ellipse( 64, vec3(0.0,0.0,-1.0), vec3(1.0,0.0,0.0), vec3(0.0,1.0,0.0));
+  pcinf->style.draw_filled = false ;
+  pcinf->style.lines_color = vec3(1.0,0.0,0.0) ;
+
+  // circunferencia ecuador
+  Ellipse * pcecu = new Ellipse( 64, vec3(0.0,0.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,1.0,0.0));
+  pcecu->style.draw_filled = false ;
+  pcecu->style.close_lines = true ;
+  pcecu->style.lines_color = vec3(0.4,0.4,0.4) ;
+  pcecu->style.lines_width = 0.002 ;
+
+  // circunferencia superior
+  Ellipse * pcsup = new Ellipse( 64, vec3(0.0,0.0,1.0), vec3(1.0,0.0,0.0), vec3(0.0,1.0,0.0));
+  pcsup->style.draw_filled = false ;
+  pcsup->style.lines_color = vec3(1.0,0.0,0.0) ;
+
+  // segmentos verticales que delimitan el cilindro
+  const vec3 v  = cam.src.zAxis.normalized() ;
+  const real s  = sqrt(v[0]*v[0]+v[1]*v[1]);
+  const vec3 n1 = vec3(  v[1]/s, -v[0]/s, -1.0 ),
+             n2 = vec3( -v[1]/s,  v[0]/s, -1.0 );
+  Segment
+    * s1 = new Segment( n1, vec3(0.0,0.0,2.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width ),
+    * s2 = new Segment( n2, vec3(0.0,0.0,2.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width );
+
+    add( pcinf );
+    add( pcecu );
+    add( pcsup );
+    add( s1 );
+    add( s2 );
+}
+
+// *****************************************************************************
+// class JoiningQuads
+// -----------------------------------------------------------------------------
+
+JoiningQuads::JoiningQuads( const Polygon & p1, const Polygon & p2 )
+{
+  const VertexArrayView v1 = p1.vertexes3D(),
+                        v2 = p2.vertexes3D();
+  const int n = v1.size() ;
+  assert( n == v2.size() );
+
+  for( unsigned i = 0 ; i < n-1 ; i++ )
+  {
+      // crear poligono y popularlo y añadirlo
+      const vec3
+        p00 = v1[i], p01 = v1[i+1],
+        p10 = v2[i], p11 = v2[i+1] ;
+      add( new PolQuad( p00, p01, p10, p11 ) );
+  }
+  // añadir cierre
+  const vec3
+    p00 = v1[n-1], p01 = v1[0],
+    p10 = v2[n-1], p11 = v2[0] ;
+  add( new PolQuad( p00, p01, p10, p11 ) );
+}
+
+// *****************************************************************************
+// class SVGDefs
+// -----------------------------------------------------------------------------
+// an object in the tree below the root set, with the hash and size of its SVG
+// output relative to its bounding box
+
+class SVGDefsNode
+{
+   public:
+   Object *                 obj ;
+   std::uint64_t            key ;
+   std::size_t              bytes ;
+   std::vector<std::size_t> children ; // indexes of the children nodes
+} ;
+// -----------------------------------------------------------------------------
+
+static void collect_defs_nodes( Object * obj, std::vector<SVGDefsNode> & nodes )
+{
+   std::ostringstream os ;
+   SVGContext ctx ;
+   ctx.os     = &os ;
+   ctx.offset = obj->min ;
+   obj->drawSVG( ctx );
+
+   const std::string text = os.str() ;
+   SceneHasher h ;
+   h.add( text );
+
+   const std::size_t index = nodes.size() ;
+   nodes.push_back( SVGDefsNode() );
+   nodes[index].obj   = obj ;
+   nodes[index].key   = h.value() ;
+   nodes[index].bytes = text.size() ;
+
+   ObjectsSet * set = dynamic_cast<ObjectsSet *>( obj );
+   if ( set != nullptr )
+      for( Object * child : set->objetos )
+      {
+         nodes[index].children.push_back( nodes.size() );
+         collect_defs_nodes( child, nodes );
+      }
+}
+// -----------------------------------------------------------------------------
+// select the outermost repeated nodes (in document order)
+
+static void select_defs_nodes( const std::vector<SVGDefsNode> & nodes, std::size_t index,
+                               const std::map<std::uint64_t,std::size_t> & counts,
+                               const std::set<std::uint64_t> & excluded, std::size_t min_bytes,
+                               std::vector<std::size_t> & selected )
+{
+   const SVGDefsNode & node = nodes[index] ;
+   if ( 2 <= counts.at( node.key ) && min_bytes <= node.bytes && excluded.count( node.key ) == 0 )
+   {
+      selected.push_back( index );
+      return ;
+   }
+   for( std::size_t child : node.children )
+      select_defs_nodes( nodes, child, counts, excluded, min_bytes, selected );
+}
+// -----------------------------------------------------------------------------
+
+SVGDefs::SVGDefs( ObjectsSet & root, std::size_t min_bytes )
+{
+   std::vector<SVGDefsNode> nodes ;
+   std::vector<std::size_t> roots ;
+   for( Object * child : root.objetos )
+   {
+      assert( child != nullptr );
+      roots.push_back( nodes.size() );
+      collect_defs_nodes( child, nodes );
+   }
+
+   std::map<std::uint64_t,std::size_t> counts ;
+   for( const SVGDefsNode & node : nodes )
+      counts[node.key]++ ;
+
+   // a repeated subgraph can end up used just once (when the other occurrences
+   // are inside larger repeated subgraphs): exclude it and select again
+   std::set<std::uint64_t>  excluded ;
+   std::vector<std::size_t> selected ;
+   while ( true )
+   {
+      selected.clear();
+      for( std::size_t r : roots )
+         select_defs_nodes( nodes, r, counts, excluded, min_bytes, selected );
+
+      std::map<std::uint64_t,std::size_t> num_uses ;
+      for( std::size_t i : selected )
+         num_uses[nodes[i].key]++ ;
+
+      bool changed = false ;
+      for( const auto & e : num_uses )
+         if ( e.second < 2 )
+         {
+            excluded.insert( e.first );
+            changed = true ;
+         }
+      if ( ! changed )
+         break ;
+   }
+
+   // the first occurrence of each subgraph is the definition, written as it is
+   std::map<std::uint64_t,std::size_t> def_of_key ;
+   std::vector<vec2>                    def_min ;
+   for( std::size_t i : selected )
+   {
+      Object * obj = nodes[i].obj ;
+      auto it = def_of_key.find( nodes[i].key );
+      if ( it == def_of_key.end() )
+      {
+         std::ostringstream os ;
+         SVGContext ctx ;
+         ctx.os = &os ;
+         obj->drawSVG( ctx );
+
+         it = def_of_key.insert( std::make_pair( nodes[i].key, defs.size() ) ).first ;
+         defs.push_back( os.str() );
+         def_min.push_back( obj->min );
+      }
+      Use & use = uses[obj] ;
+      use.def_index   = it->second ;
+      use.translation = obj->min - def_min[it->second] ;
+   }
+}
+// -----------------------------------------------------------------------------
+
+void SVGDefs::writeDefs( std::ostream & os ) const
+{
+   for( std::size_t i = 0 ; i < defs.size() ; i++ )
+      os << "<g id='subgraph" << i << "'>" << std::endl
+         << defs[i]
+         << "</g>" << std::endl ;
+}
+// -----------------------------------------------------------------------------
+
+bool SVGDefs::writeUse( const Object * obj, std::ostream & os ) const
+{
+   auto it = uses.find( obj );
+   if ( it == uses.end() )
+      return false ;
+
+   const Use & use = it->second ;
+   os << "<use xlink:href='#subgraph" << use.def_index << "'" ;
+   if ( use.translation[0] != 0.0 || use.translation[1] != 0.0 )
+      os << " transform='translate(" << use.translation[0] << " " << use.translation[1] << ")'" ;
+   os << "/>" << std::endl ;
+   return true ;
+}
+
+// *****************************************************************************
+// class Figure
+// -----------------------------------------------------------------------------
+
+Figure::Figure()
+{
+   width_cm = 20.0 ;
+   flip_axes = false ;
+   svgz_level = 6 ;
+   svg_use_defs = true ;
+   svg_mapped_min_bytes = std::size_t(64) << 20 ;
+   size_stats = nullptr ;
+}
+// -----------------------------------------------------------------------------
+
+Figure::~Figure()
+{
+
+}
+// -----------------------------------------------------------------------------
+
+static bool has_suffix( const std::string & str, const std::string & suffix )
+{
+   return suffix.size() <= str.size() &&
+          str.compare( str.size()-suffix.size(), suffix.size(), suffix ) == 0 ;
+}
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// PNG scale (pixels per projected unit) and height, for a given width
+
+static void png_geometry( const vec2 & box_w, unsigned width_px, real & scale, unsigned & height_px )
+{
+   scale     = real(width_px)/box_w[0] ;
+   height_px = std::max( 1u, unsigned( box_w[1]*scale + real(0.5) ) );
+}
+// -----------------------------------------------------------------------------
+// PDF page size and scale (points per projected unit)
+
+static void pdf_geometry( const vec2 & box_w, real width_cm, real & page_w, real & page_h, real & scale )
+{
+   page_w = width_cm/real(2.54)*real(72.0) ; // points (1/72 inch)
+   scale  = page_w/box_w[0] ;
+   page_h = box_w[1]*scale ;
+}
+// -----------------------------------------------------------------------------
+// hash of an output file: the figure hash plus the format and its options
+
+static std::string output_hash( SceneHasher h, const std::string & nombre_arch,
+                                unsigned width_px, int svgz_level, bool svg_use_defs )
+{
+   h.add( "output v4" ); // (to be changed when the writers output changes)
+   if ( has_suffix( nombre_arch, ".png" ) )
+   {
+      h.add( "png" );
+      h.add( std::uint64_t( width_px ) );
+   }
+   else if ( has_suffix( nombre_arch, ".pdf" ) )
+      h.add( "pdf" );
+   else if ( has_suffix( nombre_arch, ".svgz" ) )
+   {
+      h.add( "svgz" );
+      h.add( svgz_level );
+      h.add( svg_use_defs );
+   }
+   else
+   {
+      h.add( "svg" );
+      h.add( svg_use_defs );
+   }
+   return h.hex() ;
+}
+// -----------------------------------------------------------------------------
+
+void Figure::hash( SceneHasher & h ) const
+{
+   cam.hash( h );
+   h.add( width_cm );
+   objetos.hash( h );
+}
+// -----------------------------------------------------------------------------
+
+void Figure::draw( const std::vector<std::string> & nombres_arch, unsigned width_px )
+{
+   skipped_files.clear();
+   if ( manifest_path.empty() )
+   {
+      drawFiles( nombres_arch, width_px );
+      return ;
+   }
+
+   SceneHasher scene ;
+   hash( scene );
+
+   HashManifest manifest( manifest_path );
+   std::vector<std::string> pendientes, hashes ;
+   for( const std::string & nombre_arch : nombres_arch )
+   {
+      const std::string h = output_hash( scene, nombre_arch, width_px, svgz_level, svg_use_defs );
+      if ( manifest.upToDate( nombre_arch, h ) )
+         skipped_files.push_back( nombre_arch );
+      else
+      {
+         pendientes.push_back( nombre_arch );
+         hashes.push_back( h );
+      }
+   }
+   if ( pendientes.empty() )
+      return ;
+
+   drawFiles( pendientes, width_px );
+   for( std::size_t i = 0 ; i < pendientes.size() ; i++ )
+      manifest.update( pendientes[i], hashes[i] );
+}
+// -----------------------------------------------------------------------------
+
+void Figure::drawFiles( const std::vector<std::string> & nombres_arch, unsigned width_px )
+{
+   using namespace std ;
+   assert( 0 < width_px );
+
+   vec2 box_min, box_w ;
+   viewBox( box_min, box_w ); // (objects are projected just once, here)
+
+   // raster and PDF scales and sizes
+   real     px_scale, page_w, page_h, pt_scale ;
+   unsigned height_px ;
+   png_geometry( box_w, width_px, px_scale, height_px );
+   pdf_geometry( box_w, width_cm, page_w, page_h, pt_scale );
+
+   // create the outputs
+   std::unique_ptr<std::ostream>                svg_os ;
+   GzipOStream *                                svgz_os = nullptr ;
+   MappedOStream *                              mapped_os = nullptr ;
+   std::vector< std::unique_ptr<RasterCanvas> > canvases ;
+   std::vector< std::unique_ptr<RasterSink> >   raster_sinks ;
+   std::vector< std::unique_ptr<PDFWriter> >    pdf_writers ;
+   std::vector< std::string >                   png_names, pdf_names ;
+   RenderSinks                                  sinks ;
+
+   for( const std::string & nombre_arch : nombres_arch )
+   {
+      if ( has_suffix( nombre_arch, ".png" ) )
+      {
+         canvases.emplace_back( new RasterCanvas( width_px, height_px ) );
+         raster_sinks.emplace_back( new RasterSink( *canvases.back(), box_min, box_w, px_scale ) );
+         sinks.add( raster_sinks.back().get() );
+         png_names.push_back( nombre_arch );
+      }
+      else if ( has_suffix( nombre_arch, ".pdf" ) )
+      {
+         pdf_writers.emplace_back( new PDFWriter( page_w, page_h, box_min, pt_scale ) );
+         sinks.add( pdf_writers.back().get() );
+         pdf_names.push_back( nombre_arch );
+      }
+      else if ( svg_os != nullptr )
+         throw std::runtime_error( "cannot write more than one SVG file at once ('" + nombre_arch + "')" );
+      else if ( has_suffix( nombre_arch, ".svgz" ) )
+      {
+         svgz_os = new GzipOStream( nombre_arch, svgz_level );
+         svg_os.reset( svgz_os );
+      }
+      else
+      {
+         // large outputs: formatted straight into the pages of the file
+         const std::size_t estimate = 4096 + objetos.svgSizeEstimate() ;
+         if ( svg_mapped_min_bytes <= estimate )
+         {
+            mapped_os = new MappedOStream( nombre_arch, estimate );
+            svg_os.reset( mapped_os );
+         }
+         else
+            svg_os.reset( new std::fstream( nombre_arch, ios_base::out ) );
+      }
+   }
+
+   // bytes accounting: the SVG is written through a counting stream buffer
+   std::unique_ptr<CountingStreamBuf> counting_buf ;
+   std::unique_ptr<std::ostream>      counted_os ;
+   if ( svg_os != nullptr && size_stats != nullptr )
+   {
+      counting_buf.reset( new CountingStreamBuf( svg_os->rdbuf() ) );
+      counted_os.reset( new std::ostream( counting_buf.get() ) );
+      counted_os->copyfmt( *svg_os );
+      size_stats->reset();
+      size_stats->setCounter( counting_buf.get() );
+   }
+   std::ostream * out_os = ( counted_os != nullptr ) ? counted_os.get() : svg_os.get() ;
+
+   // single traversal
+   SVGContext  svg_ctx ;
+   DrawContext ctx ;
+   std::unique_ptr<SVGDefs> svg_defs ;
+   if ( svg_os != nullptr )
+   {
+      if ( svg_use_defs )
+      {
+         svg_defs.reset( new SVGDefs( objetos ) );
+         if ( ! svg_defs->empty() )
+            svg_ctx.defs = svg_defs.get() ;
+      }
+      svg_ctx.os    = out_os ;
+      svg_ctx.stats = size_stats ;
+      ctx.svg       = &svg_ctx ;
+      beginSVG( *out_os, box_min, box_w, svg_ctx.defs );
+   }
+   if ( ! sinks.empty() )
+      ctx.sink = &sinks ;
+
+   objetos.draw( ctx );
+
+   // finish the outputs
+   if ( svg_os != nullptr )
+   {
+      endSVG( *out_os );
+      if ( size_stats != nullptr )
+      {
+         out_os->flush();
+         size_stats->setCounter( nullptr );
+      }
+      if ( svgz_os != nullptr )
+      {
+         svgz_os->close();
+         svgz_stats = svgz_os->stats() ;
+      }
+      if ( mapped_os != nullptr )
+      {
+         // (errors growing the mapping are caught by the stream, which goes bad)
+         if ( ! mapped_os->good() )
+            throw std::runtime_error( "cannot write '" + mapped_os->buffer().path() + "'" );
+         mapped_os->close();
+      }
+      svg_os.reset();
+   }
+   for( std::size_t i = 0 ; i < canvases.size() ; i++ )
+   {
+      canvases[i]->render();
+      canvases[i]->writePNG( png_names[i] );
+   }
+   for( std::size_t i = 0 ; i < pdf_writers.size() ; i++ )
+      pdf_writers[i]->write( pdf_names[i] );
 }
-
-// *****************************************************************************
-// class SegmentsVert
 // -----------------------------------------------------------------------------
 
-SegmentsVert::SegmentsVert( unsigned dn, const Polygon & p1, const Polygon & p2 )
+void Figure::drawSVG( const std::string & nombre_arch )
 {
-  const int n = p1.points3D.size() ;
-  assert( n == p2.points3D.size() );
-
-  const vec3 color = vec3( 0.0, 0.7, 1.0 );
-  constexpr real width =  0.0025 ;
-
-  for( unsigned i = 0 ; i < n ; i += dn )
-  {
-      Segment * psegmento = new Segment( p1.points3D[i], p2.points3D[i]-p1.points3D[i], color, width );
-      add( psegmento );
-  }
+   draw( { nombre_arch } );
 }
-
-// *****************************************************************************
-// class Axes
 // -----------------------------------------------------------------------------
 
-Axes::Axes( real widthl, bool flip   )  // widthl = width de línea
+void Figure::drawPNG( const std::string & nombre_arch, unsigned width_px )
 {
-  vec3 o = vec3(0.0,0.0,0.0);
-
-  if ( flip )  // draw X and Y in the horizontal plane
-  {
-    add( new Segment( o, vec3(1.0,0.0,0.0),  vec3(1.0,0.7,0.7), widthl ) );
-    add( new Segment( o, vec3(0.0,0.0,-1.0), vec3(0.6,0.7,0.6), widthl ) );
-    add( new Segment( o, vec3(0.0,1.0,0.0),  vec3(0.7,0.7,1.0), widthl ) );
-  }
-  else
-  {
-    add( new Segment( o, vec3(1.0,0.0,0.0), vec3(1.0,0.0,0.0), widthl ) );
-    add( new Segment( o, vec3(0.0,1.0,0.0), vec3(0.0,0.5,0.0), widthl ) );
-    add( new Segment( o, vec3(0.0,0.0,1.0), vec3(0.0,0.0,1.0), widthl ) );
-  }
+   draw( { nombre_arch }, width_px );
 }
-
-// *****************************************************************************
-// class YAxisProjectorsSegments
 // -----------------------------------------------------------------------------
 
-YAxisProjectorsSegments::YAxisProjectorsSegments( unsigned dn, const Polygon & p1 )
+void Figure::drawPDF( const std::string & nombre_arch )
 {
-  const int n = p1.points3D.size() ;
-  assert( 0 < n );
-  const vec3 color = vec3( 0.0, 0.7, 1.0 );
-  constexpr real width =  0.0025 ;
-
-  for( unsigned i = 0 ; i < n ; i += dn )
-  {
-      const vec3 pesf = p1.points3D[i] ,
-                 pyAxis = vec3(0.0,pesf[1],0.0);
-
-      add( new Segment( pyAxis, pesf-pyAxis, color, width ));
-  }
+   draw( { nombre_arch } );
 }
-// *****************************************************************************
-// class YAxisCylinder
 // -----------------------------------------------------------------------------
 
-YAxisCylinder::YAxisCylinder( const Camera & cam )
+std::string Figure::drawBytes( const std::string & format, unsigned width_px )
 {
+   assert( 0 < width_px );
 
-  // circunferencia inferior
-  Ellipse * pcinf = new Ellipse( 64, vec3(0.0,-1.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,0.0,1.0));
-  pcinf->style.draw_filled = false ;
-  pcinf->style.lines_color = vec3(1.0,0.0,0.0) ;
-
-  // circunferencia ecuador
-  Ellipse * pcecu = new Ellipse( 64, vec3(0.0,0.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,0.0,1.0));
-  pcecu->style.draw_filled = false ;
-  pcecu->style.close_lines = true ;
-  pcecu->style.lines_color = vec3(0.4,0.4,0.4) ;
-  pcecu->style.lines_width = 0.002 ;
+   vec2 box_min, box_w ;
+   viewBox( box_min, box_w );
 
-  // circunferencia superior
-  Ellipse * pcsup = new Ellipse( 64, vec3(0.0,1.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,0.0,1.0));
-  pcsup->style.draw_filled = false ;
-  pcsup->style.lines_color = vec3(1.0,0.0,0.0) ;
+   if ( format == "svg" )
+   {
+      std::ostringstream os ;
+      drawSVG( os );
+      return os.str() ;
+   }
 
-  // segmentos verticales que delimitan el cilindro
-  const vec3 v  = cam.src.zAxis.normalized() ;
-  const real s  = sqrt(v[0]*v[0]+v[2]*v[2]);
-  const vec3 n1 = vec3(  v[2]/s, -1.0, -v[0]/s ),
-             n2 = vec3( -v[2]/s, -1.0,  v[0]/s );
-  Segment
-    * s1 = new Segment( n1, vec3(0.0,2.0,0.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width ),
-    * s2 = new Segment( n2, vec3(0.0,2.0,0.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width );
+   DrawContext ctx ;
+   if ( format == "png" )
+   {
+      real     scale ;
+      unsigned height_px ;
+      png_geometry( box_w, width_px, scale, height_px );
+
+      RasterCanvas canvas( width_px, height_px );
+      RasterSink   sink( canvas, box_min, box_w, scale );
+      ctx.sink = &sink ;
+      objetos.draw( ctx );
+      canvas.render();
+      return canvas.encodePNG() ;
+   }
+   if ( format == "pdf" )
+   {
+      real page_w, page_h, scale ;
+      pdf_geometry( box_w, width_cm, page_w, page_h, scale );
 
-    add( pcinf );
-    add( pcecu );
-    add( pcsup );
-    add( s1 );
-    add( s2 );
+      PDFWriter writer( page_w, page_h, box_min, scale );
+      ctx.sink = &writer ;
+      objetos.draw( ctx );
+      return writer.encode() ;
+   }
+   throw std::runtime_error( "unknown output format '" + format + "' (must be svg, png or pdf)" );
 }
-
-// *****************************************************************************
-// class ZAxisCylinder
 // -----------------------------------------------------------------------------
 
-ZAxisCylinder::ZAxisCylinder( const Camera & cam )
+void Figure::viewBox( vec2 & box_min, vec2 & box_w )
 {
+   if ( ! objetos.projected )
+      objetos.project( cam ) ;
 
-  // circunferencia inferior
-  Ellipse * pcinf = new Ellipse( 64, vec3(0.0,0.0,-1.0), vec3(1.0,0.0,0.0), vec3(0.0,1.0,0.0));
-  pcinf->style.draw_filled = false ;
-  pcinf->style.lines_color = vec3(1.0,0.0,0.0) ;
-
-  // circunferencia ecuador
-  Ellipse * pcecu = new Ellipse( 64, vec3(0.0,0.0,0.0), vec3(1.0,0.0,0.0), vec3(0.0,1.0,0.0));
-  pcecu->style.draw_filled = false ;
-  pcecu->style.close_lines = true ;
-  pcecu->style.lines_color = vec3(0.4,0.4,0.4) ;
-  pcecu->style.lines_width = 0.002 ;
+   constexpr real fmrg = 0.01 ; // width del margen en X y en Y, expresado en porcentaje del width en X
+   //cout << "objetos.min == " << objetos.max << ", objetos.max == " << objetos.min << endl ;
 
-  // circunferencia superior
-  Ellipse * pcsup = new Ellipse( 64, vec3(0.0,0.0,1.0), vec3(1.0,0.0,0.0), vec3(0.0,1.0,0.0));
-  pcsup->style.draw_filled = false ;
-  pcsup->style.lines_color = vec3(1.0,0.0,0.0) ;
+   const real ax       = objetos.max[0]-objetos.min[0] ;
+   const vec2 vmargen  = vec2( fmrg*ax, fmrg*ax );
+   const vec2 ptos_min = objetos.min,
+              ptos_w   = objetos.max-objetos.min ;
 
-  // segmentos verticales que delimitan el cilindro
-  const vec3 v  = cam.src.zAxis.normalized() ;
-  const real s  = sqrt(v[0]*v[0]+v[1]*v[1]);
-  const vec3 n1 = vec3(  v[1]/s, -v[0]/s, -1.0 ),
-             n2 = vec3( -v[1]/s,  v[0]/s, -1.0 );
-  Segment
-    * s1 = new Segment( n1, vec3(0.0,0.0,2.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width ),
-    * s2 = new Segment( n2, vec3(0.0,0.0,2.0), vec3(1.0,0.0,0.0), pcinf->style.lines_width );
+   box_min = ptos_min-vmargen ;
+   box_w   = ptos_w+real(2.0)*vmargen ;
 
-    add( pcinf );
-    add( pcecu );
-    add( pcsup );
-    add( s1 );
-    add( s2 );
+   assert( 0 < box_w[0] && 0 < box_w[1] );
 }
-
-// *****************************************************************************
-// class JoiningQuads
 // -----------------------------------------------------------------------------
 
-JoiningQuads::JoiningQuads( const Polygon & p1, const Polygon & p2 )
+void Figure::drawSVG( std::ostream & fout )
 {
-  const int n = p1.points3D.size() ;
-  assert( n == p2.points3D.size() );
+   vec2 box_min, box_w ;
+   viewBox( box_min, box_w );
+
+   // bytes accounting: written through a counting stream buffer
+   CountingStreamBuf counting_buf( fout.rdbuf() );
+   std::ostream      counted_os( &counting_buf );
+   std::ostream &    os = ( size_stats != nullptr ) ? counted_os : fout ;
+   if ( size_stats != nullptr )
+   {
+      counted_os.copyfmt( fout );
+      size_stats->reset();
+      size_stats->setCounter( &counting_buf );
+   }
 
-  for( unsigned i = 0 ; i < n-1 ; i++ )
-  {
-      // crear poligono y popularlo y añadirlo
-      const vec3
-        p00 = p1.points3D[i], p01 = p1.points3D[i+1],
-        p10 = p2.points3D[i], p11 = p2.points3D[i+1] ;
-      add( new PolQuad( p00, p01, p10, p11 ) );
-  }
-  // añadir cierre
-  const vec3
-    p00 = p1.points3D[n-1], p01 = p1.points3D[0],
-    p10 = p2.points3D[n-1], p11 = p2.points3D[0] ;
-  add( new PolQuad( p00, p01, p10, p11 ) );
-}
+   SVGContext ctx ;
+   ctx.os    = &os ;
+   ctx.stats = size_stats ;
 
-// *****************************************************************************
-// class Figure
-// -----------------------------------------------------------------------------
+   std::unique_ptr<SVGDefs> svg_defs ;
+   if ( svg_use_defs )
+   {
+      svg_defs.reset( new SVGDefs( objetos ) );
+      if ( ! svg_defs->empty() )
+         ctx.defs = svg_defs.get() ;
+   }
 
-Figure::Figure()
-{
-   width_cm = 20.0 ;
-   flip_axes = false ;
+   beginSVG( os, box_min, box_w, ctx.defs );
+   objetos.drawSVG( ctx );
+   endSVG( os );
+
+   if ( size_stats != nullptr )
+   {
+      os.flush();
+      size_stats->setCounter( nullptr );
+   }
 }
 // -----------------------------------------------------------------------------
 
-void Figure::drawSVG( const std::string & nombre_arch )
+void Figure::beginSVG( std::ostream & fout, const vec2 & box_min, const vec2 & box_w,
+                       const SVGDefs * svg_defs )
 {
    using namespace std ;
-   std::fstream fout( nombre_arch, ios_base::out) ;
 
-   if ( ! objetos.projected )
-      objetos.project( cam ) ;
-
-   SVGContext ctx ;
-   ctx.os = &fout ;
-
-   constexpr real fmrg = 0.01 ; // width del margen en X y en Y, expresado en porcentaje del width en X
-   //cout << "objetos.min == " << objetos.max << ", objetos.max == " << objetos.min << endl ;
-
-   const real ax       = objetos.max[0]-objetos.min[0] ;
-   const vec2 vmargen  = vec2( fmrg*ax, fmrg*ax );
-   const vec2 ptos_min = objetos.min,
-              ptos_w   = objetos.max-objetos.min,
-              box_min  = ptos_min-vmargen,
-              box_w    = ptos_w+real(2.0)*vmargen ;
-
-   assert( 0 < box_w[0] && 0 < box_w[1] );
    real ratio = box_w[1]/box_w[0] ;
 
    const real wx = width_cm,      // width en centimetros
               wy = wx*ratio ;
 
+   SVGSizeMark from ;
+   if ( size_stats != nullptr )
+      from = size_stats->mark() ;
+
    // cabecera svg
-   fout << "<svg xmlns='http://www.w3.org/2000/svg' " << endl
+   fout << "<svg xmlns='http://www.w3.org/2000/svg' " ;
+   if ( svg_defs != nullptr )
+      fout << "xmlns:xlink='http://www.w3.org/1999/xlink' " ;
+   fout << endl
         << "     width='" << wx << "cm' height='" << wy << "cm' " << endl
         << "     viewBox='" << box_min[0] << " " << box_min[1] << " " << box_w[0] << " " << box_w[1] << "'" << endl
         << ">" << endl ;
 
 
-   //write_radial_gradient_def( fout, "hemisphereGradFill" );
+   // definitions of the gradients referenced by the objects (each one once)
+   std::set<std::string> gradients ;
+   objetos.collectGradients( gradients );
 
+   if ( size_stats != nullptr )
+   {
+      size_stats->add( SVGBytes::Header, from );
+      from = size_stats->mark() ;
+   }
    fout << "<defs>" << endl ;
-   write_radial_gradient_def( fout, "hemisphereGradFill" );
-   write_radial_gradient_def_blue( fout, "spherecapGradFill" );
+   for( const std::string & name : gradients )
+      GradientRegistry::writeSVG( fout, name );
+   if ( svg_defs != nullptr )
+      svg_defs->writeDefs( fout );
    fout << "</defs>" << endl ;
 
+   if ( size_stats != nullptr )
+   {
+      size_stats->add( SVGBytes::Defs, from );
+      from = size_stats->mark() ;
+   }
    fout << "<g transform='translate(0.0 " << real(2.0)*box_min[1]+box_w[1] << ") scale(1.0 -1.0)'> <!-- transf global (inv y) -->"<< endl ;
 
+   if ( size_stats != nullptr )
+      size_stats->add( SVGBytes::Header, from );
+}
+// -----------------------------------------------------------------------------
 
+void Figure::endSVG( std::ostream & fout )
+{
+   using namespace std ;
 
-   // objetos svg
-   objetos.drawSVG( ctx );
+   SVGSizeMark from ;
+   if ( size_stats != nullptr )
+      from = size_stats->mark() ;
 
    // pie svg
    fout << "</g>" << endl ;
    fout << "</svg>" << endl ;
 
-   fout.close();
+   if ( size_stats != nullptr )
+      size_stats->add( SVGBytes::Header, from );
+}
+
+//******************************************************************************
+// clipping of spherical polygons to the upper hemisphere
+// -----------------------------------------------------------------------------
+// point of the equator at angle 'ang' (from +X towards +Z)
+
+static vec3 equator_point( double ang )
+{
+  return vec3( real(std::cos( ang )), 0.0, real(std::sin( ang )) );
+}
+// -----------------------------------------------------------------------------
+// crossing of the great circle arc from 'a' (y >= 0) to 'b' (y < 0), or from
+// 'a' (y < 0) to 'b' (y >= 0), with the equator: the chord crosses the plane
+// y=0 at a point on the plane of the arc, which is then normalized
+
+static vec3 equator_crossing( const vec3 & a, const vec3 & b )
+{
+  const double t = double(a[1])/( double(a[1])-double(b[1]) ),
+               x = double(a[0]) + t*( double(b[0])-double(a[0]) ),
+               z = double(a[2]) + t*( double(b[2])-double(a[2]) ),
+               l = std::sqrt( x*x + z*z );
+  return vec3( real(x/l), 0.0, real(z/l) );
+}
+// -----------------------------------------------------------------------------
+// angle of the projection of 'p' onto the equator
+
+static double equator_angle( const vec3 & p )
+{
+  return std::atan2( double(p[2]), double(p[0]) );
+}
+// -----------------------------------------------------------------------------
+// signed angle from 'a0' to 'a1', in [-pi,pi)
+
+static double angle_step( double a0, double a1 )
+{
+  double d = a1-a0 ;
+  while ( d < -M_PI )  d += 2.0*M_PI ;
+  while ( M_PI <= d )  d -= 2.0*M_PI ;
+  return d ;
+}
+// -----------------------------------------------------------------------------
+// append the vertexes of the equator arc from 'from' (excluded) to 'to'
+// (included), with a signed sweep angle 'sweep'
+
+static void append_equator_arc( const vec3 & from, const vec3 & to, double sweep,
+                                unsigned arc_segments, std::vector<vec3> & out )
+{
+  const double   a0 = equator_angle( from );
+  const unsigned n  = unsigned( std::ceil( std::fabs( sweep )*double(arc_segments)/(2.0*M_PI) ) );
+  for( unsigned j = 1 ; j < n ; j++ )
+    out.push_back( equator_point( a0 + sweep*double(j)/double(n) ) );
+  out.push_back( to );
+}
+// -----------------------------------------------------------------------------
+// clip the closed spherical polygon 'on_sphere' (unit vectors) to y >= 0. Returns
+// false (and 'out' is not changed) when there is nothing to clip. When all the
+// vertexes are below the equator, they are just projected onto it.
+
+static bool clip_upper_hemisphere( const VertexArrayView & on_sphere, unsigned arc_segments,
+                                   std::vector<vec3> & out )
+{
+  const std::size_t n = on_sphere.size() ;
+  std::vector<vec3> s( n );
+  on_sphere.readBlock( 0, n, s.data() );
+
+  std::size_t first_above = n ;
+  bool        any_below   = false ;
+  for( std::size_t i = 0 ; i < n ; i++ )
+  {
+    if ( s[i][1] < 0.0 )
+      any_below = true ;
+    else if ( first_above == n )
+      first_above = i ;
+  }
+  if ( ! any_below )
+    return false ;
+
+  out.clear();
+  if ( first_above == n )
+  {
+    apply_map_batch( VertexMap::ClipToHemisphere, s.data(), n );
+    out = s ;
+    return true ;
+  }
+
+  // walk the edges starting at a vertex above the equator. Along each part below
+  // the equator, the angles of the vertexes projected onto it are accumulated
+  // (in small steps), so the arc goes around the same side, the same number of turns
+  vec3   exit_point ;
+  double sweep     = 0.0,
+         last_angle = 0.0 ;
+  for( std::size_t k = 0 ; k < n ; k++ )
+  {
+    const vec3 & a = s[(first_above+k) % n],
+               & b = s[(first_above+k+1) % n] ;
+    const bool a_below = a[1] < 0.0,
+               b_below = b[1] < 0.0 ;
+
+    if ( ! a_below )
+      out.push_back( a );
 
-   //cout << "end svg " << nombre_arch << endl ;
+    if ( ! a_below && b_below )       // leaves the upper hemisphere
+    {
+      exit_point = ( a[1] == 0.0 ) ? a : equator_crossing( a, b ) ;
+      if ( a[1] != 0.0 )
+        out.push_back( exit_point );
+      last_angle = equator_angle( exit_point );
+      sweep      = 0.0 ;
+    }
+    if ( b_below )
+    {
+      const double angle = equator_angle( b );
+      sweep     += angle_step( last_angle, angle );
+      last_angle = angle ;
+    }
+    else if ( a_below )               // enters it again
+    {
+      const vec3 entry_point = ( b[1] == 0.0 ) ? b : equator_crossing( a, b ) ;
+      sweep += angle_step( last_angle, equator_angle( entry_point ) );
+      append_equator_arc( exit_point, entry_point, sweep, arc_segments, out );
+      if ( b[1] == 0.0 )
+        out.pop_back(); // ('b' itself is added by the next edge)
+    }
+  }
+  return true ;
 }
 
 //******************************************************************************
 // class SpherePolygon
 // -----------------------------------------------------------------------------
 
-SpherePolygon::SpherePolygon( const Polygon & orig, bool clip )
+SpherePolygon::SpherePolygon( const Polygon & orig, bool p_clip )
+:  original( orig )
 {
   style.draw_lines   = true ;
   style.draw_filled  = true ;
@@ -987,27 +2802,27 @@ SpherePolygon::SpherePolygon( const Polygon & orig, bool clip )
   style.lines_color  = vec3( 0.0, 0.0, 1.0 );
   style.fill_color   = vec3( 0.0, 0.0, 1.0 );
 
-  assert( orig.points3D.size() > 0 );
+  clip = p_clip ;
+  assert( orig.vertexes3D().size() > 0 );
 
-  for( unsigned i = 0 ; i < orig.points3D.size() ; i++ )
-  {
-      vec3 pesf = orig.points3D[i].normalized();
+  clipped = clip && clip_upper_hemisphere( orig.vertexes3D().mapped( VertexMap::Normalize ),
+                                           arc_segments, points3D );
+}
+// -----------------------------------------------------------------------------
 
-      if ( clip && pesf[1] < 0.0 )
-      {
-         const vec3 pcirc = vec3( pesf[0], 0.0, pesf[2] ).normalized() ;
-         points3D.push_back( pcirc );
-      }
-      else
-         points3D.push_back( pesf );
-  }
+VertexArrayView SpherePolygon::vertexes3D() const
+{
+  if ( clipped )
+    return Polygon::vertexes3D() ;
+  return original.vertexes3D().mapped( VertexMap::Normalize );
 }
 
 //******************************************************************************
 // class HorPlanePolygon
 // -----------------------------------------------------------------------------
 
-HorPlanePolygon::HorPlanePolygon( const Polygon & orig, bool clip_neg )
+HorPlanePolygon::HorPlanePolygon( const Polygon & orig, bool p_clip_neg )
+:  original( orig )
 {
   style.draw_lines   = true ;
   style.draw_filled  = true ;
@@ -1017,18 +2832,22 @@ HorPlanePolygon::HorPlanePolygon( const Polygon & orig, bool clip_neg )
   style.lines_color  = vec3( 1.0, 0.0, 0.0 );
   style.fill_color   = vec3( 1.0, 0.0, 0.0 );
 
-  assert( orig.points3D.size() > 0 );
-  for( auto orig_pnt : orig.points3D )
-  {
-      // project onto sphere (normalize)
-      const vec3 sph_pnt = orig_pnt.normalized() ,    // sphere point
-                 pln_pnt = { sph_pnt[0], 0.0, sph_pnt[2] };   // plane point
-
-      if ( !clip_neg || 0.0 <= sph_pnt[1] ) // if it is in upper hemisphere, just project
-         points3D.push_back( pln_pnt );
-      else // if in lower hemisphere, project to the circunference
-         points3D.push_back( pln_pnt.normalized() );
-  }
+  clip_neg = p_clip_neg ;
+  assert( orig.vertexes3D().size() > 0 );
+
+  clipped = clip_neg && clip_upper_hemisphere( orig.vertexes3D().mapped( VertexMap::Normalize ),
+                                               SpherePolygon::arc_segments, points3D );
+  if ( clipped )
+    apply_map_batch( VertexMap::FlattenToY0, points3D.data(), points3D.size() );
+}
+// -----------------------------------------------------------------------------
+
+VertexArrayView HorPlanePolygon::vertexes3D() const
+{
+  // project onto sphere (normalize), then onto the plane
+  if ( clipped )
+    return Polygon::vertexes3D() ;
+  return original.vertexes3D().mapped( VertexMap::Normalize ).mapped( VertexMap::FlattenToY0 );
 }
 
 //******************************************************************************
@@ -1037,21 +2856,22 @@ HorPlanePolygon::HorPlanePolygon( const Polygon & orig, bool clip_neg )
 ExtrVertSegm::ExtrVertSegm( Polygon & pol1, Polygon & pol2, const Camera & cam )
 {
    using namespace std ;
-   assert( pol1.points3D.size() == pol2.points3D.size() );
-   assert( 1 < pol1.points3D.size() );
-
-   pol1.project( cam );
-   pol2.project( cam );
+   const VertexArrayView v1 = pol1.vertexes3D(),
+                         v2 = pol2.vertexes3D();
+   assert( v1.size() == v2.size() );
+   assert( 1 < v1.size() );
 
+   // (vertexes are projected here, as the polygons' projected vertexes may have
+   // been compacted, see GeometryCheck)
    int   imin = 0,
          imax = 0 ;
-   float xmin = pol1.points3D[0][0],
-         xmax = pol2.points3D[0][0];
+   float xmin = v1[0][0],
+         xmax = v2[0][0];
 
-   for( int i = 1 ; i < pol1.points3D.size() ; i++ )
+   for( int i = 1 ; i < v1.size() ; i++ )
    {
-      const float x1 = pol1.points2D[i][0],
-                  x2 = pol2.points2D[i][0] ;
+      const float x1 = project_vertex( cam, v1, i )[0],
+                  x2 = project_vertex( cam, v2, i )[0] ;
 
       if ( std::fabs( x1-x2) > 1e-6 )
          cout << "WARNING! - non vertically aligned vertexes!" << endl ;
@@ -1068,8 +2888,8 @@ ExtrVertSegm::ExtrVertSegm( Polygon & pol1, Polygon & pol2, const Camera & cam )
       }
    }
 
-   auto * smin = new Segment( pol1.points3D[imin], pol2.points3D[imin] );
-   auto * smax = new Segment( pol1.points3D[imax], pol2.points3D[imax] );
+   auto * smin = new Segment( v1[imin], v2[imin] );
+   auto * smax = new Segment( v1[imax], v2[imax] );
 
    // tweak styles here
    smin->style.lines_width = 0.003 ;
@@ -1093,10 +2913,9 @@ YCylinderPoint::YCylinderPoint( Point & ppoint )
 {
   assert( ! ppoint.projected );
 
-  vec3       pesf = ppoint.pos3D.normalized();
-  const real f    = real(1.0)/real(sqrt( double( pesf[0]*pesf[0]+pesf[2]*pesf[2] )));
-
-  pos3D = vec3(  f*pesf[0], pesf[1], f*pesf[2]) ;
+  pos3D = ppoint.pos3D ;
+  apply_map( VertexMap::Normalize, pos3D );
+  apply_map( VertexMap::ToYCylinder, pos3D );
   color = vec3(1.0,0.0,0.0) ;
 }
 
@@ -1104,6 +2923,7 @@ YCylinderPoint::YCylinderPoint( Point & ppoint )
 // -----------------------------------------------------------------------------
 
 YCylinderPolygon::YCylinderPolygon( const Polygon & orig )
+:  original( orig )
 {
   style.draw_lines    = true ;
   style.draw_filled     = true ;
@@ -1113,20 +2933,19 @@ YCylinderPolygon::YCylinderPolygon( const Polygon & orig )
   style.lines_color   = vec3( 1.0, 0.0, 0.0 );
   style.fill_color    = vec3( 1.0, 0.0, 0.0 );
 
-  assert( orig.points3D.size() > 0 );
-  for( unsigned i = 0 ; i < orig.points3D.size() ; i++ )
-  {
-    vec3       pesf = orig.points3D[i].normalized();
-    const real f    = real(1.0)/real(sqrt( double( pesf[0]*pesf[0]+pesf[2]*pesf[2] )));
-    vec3       pcil = vec3(  f*pesf[0], pesf[1], f*pesf[2]) ;
+  assert( orig.vertexes3D().size() > 0 );
+}
+// -----------------------------------------------------------------------------
 
-    points3D.push_back( pcil );
-  }
+VertexArrayView YCylinderPolygon::vertexes3D() const
+{
+  return original.vertexes3D().mapped( VertexMap::Normalize ).mapped( VertexMap::ToYCylinder );
 }
 
 // -----------------------------------------------------------------------------
 
 ZCylinderPolygon::ZCylinderPolygon( const Polygon & orig )
+:  original( orig )
 {
   style.draw_lines    = true ;
   style.draw_filled     = false ;
@@ -1136,15 +2955,13 @@ ZCylinderPolygon::ZCylinderPolygon( const Polygon & orig )
   style.lines_color   = vec3( 1.0, 0.0, 0.0 );
   style.fill_color    = vec3( 1.0, 0.0, 0.0 );
 
-  assert( orig.points3D.size() > 0 );
-  for( unsigned i = 0 ; i < orig.points3D.size() ; i++ )
-  {
-    vec3       pesf = orig.points3D[i].normalized();
-    const real f    = real(1.0)/real(sqrt( double( pesf[0]*pesf[0]+pesf[1]*pesf[1] )));
-    vec3       pcil = vec3(  f*pesf[0], f*pesf[1], pesf[2]) ;
+  assert( orig.vertexes3D().size() > 0 );
+}
+// -----------------------------------------------------------------------------
 
-    points3D.push_back( pcil );
-  }
+VertexArrayView ZCylinderPolygon::vertexes3D() const
+{
+  return original.vertexes3D().mapped( VertexMap::Normalize ).mapped( VertexMap::ToZCylinder );
 }
 
 // -----------------------------------------------------------------------------
@@ -1161,26 +2978,30 @@ ZCylinderPolygonWithSector::ZCylinderPolygonWithSector( const Polygon & orig,
    style.lines_color  = vec3( 1.0, 0.0, 0.0 );
    style.fill_color   = vec3( 1.0, 0.0, 0.0 );
 
-   assert( orig.points3D.size() > 0 );
-   for( unsigned i = 0 ; i < orig.points3D.size() ; i++ )
-   {
+   const VertexArrayView verts = orig.vertexes3D();
+   assert( verts.size() > 0 );
 
-      const vec3 porig = orig.points3D[i] ;
-      const vec3 pesf  = porig.normalized();
-      const real len   = real(sqrt( double( pesf[0]*pesf[0]+pesf[1]*pesf[1] ))) ;
+   // map all the vertexes onto the sphere (batch), then onto the cylinder
+   // those not too close to the Z axis
+   std::vector<vec3> pesf( verts.size() );
+   verts.mapped( VertexMap::Normalize ).readBlock( 0, verts.size(), pesf.data() );
+   points3D.reserve( verts.size() );
 
-      if ( len > 1e-6 )
+   std::size_t num_on_axis = 0 ;
+   for( std::size_t i = 0 ; i < verts.size() ; i++ )
+   {
+      if ( pesf[i][0]*pesf[i][0]+pesf[i][1]*pesf[i][1] > real(1e-12) )
       {
-         const real f    = real(1.0)/len;
-         const vec3 pcil = vec3(  f*pesf[0], f*pesf[1], pesf[2]) ;
+         vec3 pcil = pesf[i] ;
+         apply_map( VertexMap::ToZCylinder, pcil );
          points3D.push_back( pcil );
       }
       else
-      {
-         using namespace std ;
-         cout << "porig.length() == " << porig.length() << endl ;
-      }
+         num_on_axis++ ;
   }
+  if ( num_on_axis > 0 )
+    std::cout << "WARNING: ZCylinderPolygonWithSector: " << num_on_axis << " of " << verts.size()
+              << " vertexes on the Z axis removed" << std::endl ;
 
   // añadir el sector
 
@@ -29,8 +29,22 @@
 #include <string> // std::string, std::stoi
 #include <iostream>
 #include <fstream> // std::fstream
+#include <map>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+#include <set>
 #include <sstream> // std::stringstream (http://www.cplusplus.com/reference/sstream/stringstream/)
 #include "vector_templates.hpp"
+#include "mapped_file.hpp"
+#include "gzip_stream.hpp"
+#include "raster.hpp"
+#include "pdf_writer.hpp"
+#include "render_sink.hpp"
+#include "scene_hash.hpp"
+#include "mapping_kernels.hpp"
+#include "geometry_check.hpp"
+#include "svg_size.hpp"
 
 #define SIMPLE_PREC
 
@@ -47,40 +61,223 @@ typedef Vec4d vec4 ;
 #endif
 
 // *****************************************************************************
-// orthonormal camera coordinate system
+// VertexArrayView
+// read-only view of a sequence of 3D vertexes, either the contents of a
+// std::vector<vec3>, or a raw array of xyz triples of float or double values
+// (e.g. a memory-mapped file). Values are read in place, never copied.
+// A view can also apply a chain of mappings to each vertex as it is read (see
+// 'mapped' and VertexMap), so derived polygons need not store their vertexes:
+// the mappings are fused with the loop which reads them (e.g. the projection).
 
-class CamRefSys
+enum class VertexFormat { Float32, Float64 } ;
+
+class VertexArrayView
+{
+   public:
+   VertexArrayView() ;
+   VertexArrayView( const std::vector<vec3> & v ) ;
+   VertexArrayView( const void * p_data, std::size_t p_count, VertexFormat p_format ) ;
+
+   std::size_t size() const { return count ; }
+   vec3 operator [] ( std::size_t i ) const { return at<real>( i ); }
+
+   // vertex 'i' converted to type T (float64 data is not rounded when T is double),
+   // with the mappings applied (computed with type T)
+   template< class T > VectorTempl3<T> at( std::size_t i ) const ;
+
+   // read vertexes [first,first+n) into 'out', with the mappings applied by the
+   // batch kernels (the same values as 'at<real>')
+   void readBlock( std::size_t first, std::size_t n, vec3 * out ) const ;
+
+   // a view of the same vertexes, with 'm' applied after the current mappings
+   VertexArrayView mapped( VertexMap m ) const ;
+
+   static constexpr unsigned max_maps = 8 ; // max. length of the chain of mappings
+
+   private:
+   const void * data ;   // first coordinate of first vertex
+   std::size_t  count ;  // number of vertexes
+   VertexFormat format ; // type of each coordinate
+   unsigned     num_maps ; // length of the chain of mappings in 'maps'
+   VertexMap    maps[max_maps] ;
+
+   template< class T > VectorTempl3<T> read( std::size_t i ) const ; // (no mappings)
+} ;
+
+template< class T >
+inline VectorTempl3<T> VertexArrayView::read( std::size_t i ) const
+{
+   assert( i < count );
+   if ( format == VertexFormat::Float32 )
+   {
+      const float * p = static_cast<const float *>(data) + 3*i ;
+      return VectorTempl3<T>( T(p[0]), T(p[1]), T(p[2]) );
+   }
+   const double * p = static_cast<const double *>(data) + 3*i ;
+   return VectorTempl3<T>( T(p[0]), T(p[1]), T(p[2]) );
+}
+// -----------------------------------------------------------------------------
+
+template< class T >
+inline VectorTempl3<T> VertexArrayView::at( std::size_t i ) const
+{
+   VectorTempl3<T> v = read<T>( i );
+   for( unsigned k = 0 ; k < num_maps ; k++ )
+      apply_map( maps[k], v );
+   return v ;
+}
+
+// *****************************************************************************
+// orthonormal camera coordinate system, computed with scalar type T
+
+template< class T >
+class CamRefSysT
 {
    public:
-   vec3 origin, xAxis, yAxis, zAxis ;
+   typedef VectorTempl2<T> V2 ;
+   typedef VectorTempl3<T> V3 ;
+
+   V3 origin, xAxis, yAxis, zAxis ;
 
-   CamRefSys() ;
-   CamRefSys( const vec3 & look_at, const vec3 & observer, const vec3 & p_vup );
-   void initialize( const vec3 & look_at, const vec3 & observer, const vec3 & p_vup );
-   vec2 world2cam( const vec3 & p ) const ;
+   CamRefSysT() ;
+   CamRefSysT( const V3 & look_at, const V3 & observer, const V3 & p_vup );
+   void initialize( const V3 & look_at, const V3 & observer, const V3 & p_vup );
+   V2 world2cam( const V3 & p ) const ;
 } ;
+
+typedef CamRefSysT<real> CamRefSys ;
+
 // *****************************************************************************
+// Precision:
+// scalar type used by the camera to project vertexes (vertexes and projected
+// points are always stored in 'real', that is, float):
+//   Single : float math (the default, the fastest)
+//   Mixed  : float vertexes are converted to double, projected in double
+//   Double : as Mixed, but float64 vertex data (see VertexFormat) is read
+//            directly as double, without rounding it to float first
+// Double math avoids the cancellation in (vertex-observer) for scenes with
+// large coordinates.
+
+enum class Precision { Single, Mixed, Double } ;
+
+// *****************************************************************************
+// Camera: keeps the reference system with both scalar types ('src' and
+// 'src_d'), and projects with the one selected by 'precision'
 
 class Camera
 {
    public:
-   CamRefSys src ;
+   CamRefSys          src ;
+   CamRefSysT<double> src_d ;
+   Precision          precision ;
+
    Camera( const vec3 & look_at, const vec3 & observer, const vec3 & p_vup ) ;
    Camera() ;
    vec2 project( const vec3 & p ) const ;
+   vec2 project( const Vec3d & p ) const ; // (as given, 'src' or 'src_d' by 'precision')
+   void hash( SceneHasher & h ) const ;
 };
 
+// *****************************************************************************
+// class CamRefSysT
+// -----------------------------------------------------------------------------
+
+template< class T >
+CamRefSysT<T>::CamRefSysT()
+{
+  origin = V3( 0.0, 0.0, 0.0 );
+  xAxis  = V3( 1.0, 0.0, 0.0 );
+  yAxis  = V3( 0.0, 1.0, 0.0 );
+  zAxis  = V3( 0.0, 0.0, 1.0 );
+}
+// -----------------------------------------------------------------------------
+
+template< class T >
+CamRefSysT<T>::CamRefSysT( const V3 & look_at, const V3 & observer, const V3 & p_vup )
+{
+  initialize( look_at, observer, p_vup );
+}
+// -----------------------------------------------------------------------------
+
+template< class T >
+void CamRefSysT<T>::initialize( const V3 & look_at, const V3 & observer, const V3 & p_vup )
+{
+  constexpr T epsilon = 1e-5 ;
+
+  assert( epsilon <= (observer-look_at).length() ) ;
+
+  origin = observer ;
+  zAxis = (observer-look_at).normalized();
+  xAxis = (p_vup.cross(zAxis)).normalized();  assert( std::fabs(xAxis.length()-1.0) < epsilon );
+  yAxis = (zAxis.cross(xAxis)).normalized() ; assert( std::fabs(yAxis.length()-1.0) < epsilon );
+
+  assert( xAxis.dot(yAxis) < epsilon );
+  assert( yAxis.dot(zAxis) < epsilon );
+  assert( zAxis.dot(xAxis) < epsilon );
+}
+// -----------------------------------------------------------------------------
+
+template< class T >
+inline VectorTempl2<T> CamRefSysT<T>::world2cam( const V3 & p ) const
+{
+  const V3 v = p-origin ;
+  return V2( v.dot(xAxis), v.dot(yAxis) ) ;
+}
+
+class SVGDefs ;
+
 // *****************************************************************************
 // SVGContext:
-// context information (actualy,  just a stream)
+// context information: the stream, an offset subtracted from all the projected
+// coordinates written (zero by default), and the repeated subgraphs which are
+// written as <use> elements (null by default)
 
 class SVGContext
 {
   public:
-  std::ostream * os ;
+  std::ostream *  os ;
+  vec2            offset ;
+  const SVGDefs * defs ;
+  SVGSizeStats *  stats ;  // bytes accounting (see SVGSizeStats), null by default
   SVGContext() ;
 } ;
 
+// *****************************************************************************
+// DrawContext:
+// the outputs fed by a single traversal of the objects: an SVG stream and a
+// render sink (possibly several sinks, see RenderSinks). Either can be null.
+
+class DrawContext
+{
+  public:
+  DrawContext() ;
+  SVGContext * svg ;
+  RenderSink * sink ;
+} ;
+
+// *****************************************************************************
+// class GradientRegistry
+// Named radial gradients, referenced by styles (PathStyle::grad_fill_name) and
+// objects. Each object declares the names it uses (Object::collectGradients),
+// and the SVG header defines just those gradients, once. The built-in gradients
+// are registered on first use; 'define' adds or replaces one (it must not be
+// called while figures are being drawn)
+
+class GradientRegistry
+{
+   public:
+   static const RadialGradient & get( const std::string & name ) ;
+   static void define( const std::string & name, const RadialGradient & grad ) ;
+   static bool defined( const std::string & name ) ;
+
+   // write the <radialGradient> element, add the parameters to a hash
+   static void writeSVG( std::ostream & os, const std::string & name ) ;
+   static void hash( SceneHasher & h, const std::string & name ) ;
+
+   private:
+   static std::map<std::string,RadialGradient> & table() ;
+} ;
+
 // *****************************************************************************
 // clase para styles de polígonos y quizás otros tipos de objetos
 
@@ -89,6 +286,8 @@ class PathStyle
   public:
   PathStyle();
   void writeSVG( SVGContext & ctx ); // write style attrs to an svg file
+  void hash( SceneHasher & h ) const ;
+  void collectGradients( std::set<std::string> & names ) const ; // gradients used, if any
 
   vec3  lines_color,      // lines color, when lines are drawn (draw_lines == true )
         fill_color ;      // fill color, when fill is drawn (draw_filled == true)
@@ -105,20 +304,75 @@ class PathStyle
 
 } ;
 
+// *****************************************************************************
+// class StyleTable
+// Distinct path styles, interned once and referenced by a small integer handle.
+// The SVG 'style' attribute of each style is serialized (by PathStyle::writeSVG)
+// when the style is interned, so elements just copy those bytes. Objects intern
+// their styles when projected: changes to a style after the projection are not
+// seen by 'drawSVG' until the object is projected again. All the functions can
+// be called from several threads.
+
+typedef std::uint32_t StyleHandle ;
+
+class StyleTable
+{
+   public:
+   static constexpr StyleHandle none = ~StyleHandle(0) ; // (not interned)
+
+   static StyleHandle intern( const PathStyle & style ) ; // equal styles get the same handle
+   static const PathStyle & get( StyleHandle h ) ;
+   static const std::string & svgAttrs( StyleHandle h ) ; // serialized 'style' attribute
+   static std::size_t size() ;
+
+   private:
+   class Entry
+   {
+      public:
+      PathStyle   style ;
+      std::string attrs ;
+   } ;
+   static std::mutex & mtx() ;
+   static std::deque<Entry> & entries() ;                   // (no reallocation, references are stable)
+   static std::map<std::string,StyleHandle> & handles() ;   // handle of each style key
+} ;
+
 // *****************************************************************************
 // An abstract class for things which can be drawn to an SVG file and can be
 // projected to 2d (must be projected before drawn)
+//
+// Objects are projected again only when needed: 'touch' must be called after
+// changing an object already added to a set (its vertexes, style, etc...), it
+// increases 'version' and marks the object, and all the sets containing it
+// (see ObjectsSet), as not projected.
+
+class ObjectsSet ;
 
 class Object
 {
   public:
   Object();
+  Object( const Object & other ) ;              // (the copy is not in any set)
+  Object & operator = ( const Object & other ) ; // (the sets of this object are kept, and touched)
+  void touch() ;                                 // mark as changed (see above)
   virtual void drawSVG( SVGContext & ctx ) = 0 ;
+  virtual void render( RenderSink & sink ) = 0 ; // draw with the backend-neutral primitives
+  virtual void draw( DrawContext & ctx ) ;       // draw to all the outputs in 'ctx'
   virtual void project( const Camera & cam ) = 0 ;
+  virtual void hash( SceneHasher & h ) const = 0 ; // add everything the output depends on
+  virtual void collectGradients( std::set<std::string> & names ) const ; // add names of gradients used (none by default)
+  virtual std::size_t svgSizeEstimate() const ; // approximate bytes written by 'drawSVG' (when projected)
   virtual ~Object() ;
 
   bool projected ;  // true when the points have been projected
   vec2 min,max ;    // when projected==true,
+  GeometryCheck check ; // invalid projected vertexes removed in the last projection
+  std::uint64_t version ; // number of changes ('touch' calls, includes changes in children)
+
+  private:
+  friend class ObjectsSet ;
+  void copyFrom( const Object & other ) ;
+  std::vector< std::pair<ObjectsSet *,std::size_t> > sets ; // sets with this object, and its index in each one
 } ;
 
 // *****************************************************************************
@@ -130,11 +384,45 @@ class Point : public Object
   public:
   Point( vec3 ppos3D, vec3 color );
   virtual void drawSVG( SVGContext & ctx ) ;
+  virtual void render( RenderSink & sink ) ;
   virtual void project( const Camera & cam ) ;
+  virtual void hash( SceneHasher & h ) const ;
 
   vec3 pos3D, color ;
   vec2 pos2D ;
   real radius ; // 0.03 por defecto, se puede cambiar
+  StyleHandle style_handle ; // fill style, interned when projected
+};
+
+// *****************************************************************************
+// class PointCloud
+// A large set of points (markers), drawn as filled circles: positions, colors
+// and radii are kept in contiguous arrays and projected in one pass. Each run
+// of consecutive points with the same color is written as a single <path> with
+// two arcs per point (so the drawing order is the order of insertion).
+
+class PointCloud : public Object
+{
+  public:
+  PointCloud();
+  void reserve( std::size_t n );
+  void add( const vec3 & pos, const vec3 & color, real radius = 0.03 );
+  std::size_t size() const { return positions3D.size() ; }
+
+  virtual void drawSVG( SVGContext & ctx ) ;
+  virtual void render( RenderSink & sink ) ;
+  virtual void project( const Camera & cam ) ;
+  virtual void hash( SceneHasher & h ) const ;
+  virtual std::size_t svgSizeEstimate() const ;
+
+  std::vector<vec3> positions3D, colors ;
+  std::vector<real> radii ;
+  std::vector<vec2> positions2D ;  // (when projected)
+
+  private:
+  std::vector<std::size_t> run_first,    // first point of each run of valid points with equal colors
+                           run_end ;     // (one past the last one)
+  std::vector<StyleHandle> run_styles ;  // fill style of each run (interned when projected)
 };
 
 // *****************************************************************************
@@ -149,11 +437,40 @@ class Polygon : public Object // secuencia de points
 
    virtual void project( const Camera & cam );
    virtual void drawSVG( SVGContext & ctx )  ;
+   virtual void render( RenderSink & sink ) ;
+   virtual void hash( SceneHasher & h ) const ;
+   virtual void collectGradients( std::set<std::string> & names ) const ;
+   virtual std::size_t svgSizeEstimate() const ;
    virtual ~Polygon() ;
 
+   // view of the 3D vertexes: all readers must use this instead of 'points3D',
+   // as derived classes may keep their vertexes elsewhere (see MappedPolygon)
+   virtual VertexArrayView vertexes3D() const ;
+
+   // polygons are projected in chunks of at least this number of vertexes, on
+   // several threads (polygons with less than two chunks are projected serially)
+   static constexpr std::size_t parallel_min_chunk = 32768 ;
+
    PathStyle         style ;
+   StyleHandle       style_handle ; // 'style' interned (when projected)
    std::vector<vec3> points3D ; // original points
-   std::vector<vec2> points2D ; // projected points
+   std::vector<vec2> points2D ; // projected points (without invalid ones, see 'check')
+};
+
+// *****************************************************************************
+// class MappedPolygon
+// A polygon whose vertexes are read from a binary file with packed xyz
+// triples (float32 or float64, native byte order). The file is memory-mapped
+// and used in place, 'points3D' is left empty.
+
+class MappedPolygon : public Polygon
+{
+   public:
+   MappedPolygon( const std::string & path, VertexFormat format );
+   virtual VertexArrayView vertexes3D() const ;
+
+   MappedFile   file ;
+   VertexFormat format ;
 };
 // *****************************************************************************
 // class ObjectsSet
@@ -165,10 +482,40 @@ class ObjectsSet : public Object
    ObjectsSet();
    virtual void project( const Camera & cam );
    virtual void drawSVG( SVGContext & ctx )  ;
+   virtual void render( RenderSink & sink ) ;
+   virtual void draw( DrawContext & ctx ) ;
+   virtual void hash( SceneHasher & h ) const ;
+   virtual void collectGradients( std::set<std::string> & names ) const ;
+   virtual std::size_t svgSizeEstimate() const ;
    virtual ~ObjectsSet() ;
    void add( Object * pobj );  // add one object
 
+   // children are projected and drawn in parallel, in chunks of at least this
+   // number of objects (sets with less than two chunks are visited serially).
+   // Drawing to render sinks is always serial (primitives must keep their order)
+   static constexpr std::size_t parallel_min_chunk = 32 ;
+
+   // the bounding box of the set is merged from the cached boxes of chunks of
+   // this number of children (only chunks with projected children are merged again)
+   static constexpr std::size_t bounds_chunk = 256 ;
+
+   // objects must be added with 'add' (or else all of them are projected again,
+   // each time the set is projected). Objects destroyed are removed from the set.
    std::vector<Object *> objetos ;
+
+   private:
+   friend class Object ;
+   void childChanged( std::size_t i, bool was_projected ) ; // child 'i' must be projected again
+   void childDestroyed( Object * pobj, std::size_t i ) ; // (removed from the set)
+
+   // incremental projection: children not projected since the last projection
+   // (maybe repeated), cached boxes of each chunk of children, the camera used
+   // last time (hash) and the number of children added with 'add'
+   std::vector<std::size_t> dirty ;
+   std::vector<vec2>        chunk_min, chunk_max ;
+   bool                     camera_valid ;
+   std::uint64_t            camera_key ;
+   std::size_t              num_added ;
 } ;
 
 // *****************************************************************************
@@ -182,11 +529,39 @@ class Sphere : public Object
 
    virtual void project( const Camera & cam );
    virtual void drawSVG( SVGContext & ctx )  ;
+   virtual void render( RenderSink & sink ) ;
+   virtual void hash( SceneHasher & h ) const ;
+   virtual void collectGradients( std::set<std::string> & names ) const ;
 
    real radius3D,  // original radius
         radius2D ; // projected radius (==radius3D actually)
    vec3 center3D ;
    vec2 center2D ; // when proyectado == true, 2D center
+   std::string grad_fill_name ; // gradient used for the fill ("sphereGradFill" by default)
+};
+
+// *****************************************************************************
+// class PrerenderedObject
+// An object shared by several figures with the same camera (e.g. the invariant
+// parts of a parameter sweep). The object is projected and its SVG text is
+// generated once, in the constructor; afterwards this is read-only, so it can be
+// drawn by several threads at once. 'project' does nothing (the camera given to
+// the constructor is used), and the object is not owned.
+
+class PrerenderedObject : public Object
+{
+   public:
+   PrerenderedObject( Object * p_obj, const Camera & cam ) ;
+
+   virtual void project( const Camera & cam ) ;
+   virtual void drawSVG( SVGContext & ctx ) ;
+   virtual void render( RenderSink & sink ) ;
+   virtual void hash( SceneHasher & h ) const ;
+   virtual void collectGradients( std::set<std::string> & names ) const ;
+   virtual std::size_t svgSizeEstimate() const ;
+
+   Object *    obj ;
+   std::string svg_text ; // SVG output of 'obj' (default stream format)
 };
 
 // *****************************************************************************
@@ -272,11 +647,49 @@ class EllipseSectorRadial : public ObjectsSet
    vec3    point0, point1 ;  // points extremos del segmento
 };
 
+// *****************************************************************************
+// class SegmentBatch
+// A large family of segments, with a few styles: all the endpoints are kept in
+// a single array (two consecutive vertexes per segment), projected in one pass,
+// and drawn as a single <path> (with a 'M .. L ..' subpath per segment) for
+// each style, instead of one Segment object (and one <path>) per segment.
+// Segments are drawn grouped by style, in the order the styles were added.
+
+class SegmentBatch : public Object
+{
+   public:
+   SegmentBatch();
+
+   // add a style for lines with the given color and width, returns its index
+   unsigned addStyle( const vec3 & color, real width );
+   // add the segment from 'p0' to 'p1', drawn with style 'istyle'
+   void add( const vec3 & p0, const vec3 & p1, unsigned istyle );
+
+   std::size_t numSegments() const { return ends3D.size()/2 ; }
+
+   virtual void project( const Camera & cam );
+   virtual void drawSVG( SVGContext & ctx )  ;
+   virtual void render( RenderSink & sink ) ;
+   virtual void hash( SceneHasher & h ) const ;
+   virtual std::size_t svgSizeEstimate() const ;
+
+   std::vector<PathStyle> styles ;       // styles (lines only)
+   std::vector<StyleHandle> style_handles ; // 'styles' interned (when projected)
+   std::vector<vec3>      ends3D ;       // endpoints, 2 per segment
+   std::vector<unsigned>  style_index ;  // index in 'styles' of each segment
+   std::vector<vec2>      ends2D ;       // projected endpoints (when projected)
+
+   private:
+   // segments drawn, grouped by style (those with invalid endpoints are left
+   // out): the segments with style 'is' are draw_order[style_first[is]..style_first[is+1]-1]
+   std::vector<std::size_t> draw_order, style_first ;
+} ;
+
 // *****************************************************************************
 // class SegmentsVert
 // A set of segments joining the points in two polygons (must be the same size)
 
-class SegmentsVert : public ObjectsSet
+class SegmentsVert : public SegmentBatch
 {
    public:
    SegmentsVert( unsigned dn, const Polygon & p1, const Polygon & p2 );
@@ -287,7 +700,7 @@ class SegmentsVert : public ObjectsSet
 //
 // three segments for the orthonormal world reference system
 
-class Axes : public ObjectsSet
+class Axes : public SegmentBatch
 {
    public:
    Axes( real widthl, bool flip = false );
@@ -297,7 +710,7 @@ class Axes : public ObjectsSet
 // class YAxisProjectorsSegments
 // a set of segments from each vertex of a polygon towards Y axis
 
-class YAxisProjectorsSegments : public ObjectsSet
+class YAxisProjectorsSegments : public SegmentBatch
 {
    public:
    YAxisProjectorsSegments( unsigned dn, const Polygon & p1 );
@@ -336,22 +749,45 @@ class JoiningQuads : public ObjectsSet
 
 // *****************************************************************************
 // class SpherePolygon
-// a polygon obtained by projecting another one onto the Sphere
+// a polygon obtained by projecting another one onto the Sphere. When 'clip' is
+// true, it is clipped to the upper hemisphere (y >= 0): the exact crossing
+// points of the edges (great circle arcs) with the equator are inserted, and
+// the parts below it are replaced by arcs of the equator.
+// Vertexes are not stored (unless clipping actually removes some part): they
+// are mapped from the original polygon (which must outlive this one) each time
+// they are read.
 
 class SpherePolygon : public Polygon
 {
   public:
   SpherePolygon( const Polygon & orig, bool clip = false ) ;
+  virtual VertexArrayView vertexes3D() const ;
+
+  // equator arcs have one vertex each 2*pi/arc_segments radians (at most)
+  static constexpr unsigned arc_segments = 256 ;
+
+  const Polygon & original ;
+  bool            clip ;
+  bool            clipped ; // true when the clipped vertexes are stored in 'points3D'
 };
 
 // *****************************************************************************
 // class HorPlanePolygon
-// a polygon obtained by projecting another one onto the (horizontal) plane at Y=0
+// a polygon obtained by projecting another one onto the sphere, and then onto
+// the (horizontal) plane at Y=0 (when 'clip_neg' is true, the spherical polygon
+// is clipped to the upper hemisphere first, as in SpherePolygon, so its parts
+// in the lower hemisphere become arcs of the circumference). Vertexes are
+// mapped from the original polygon, as in SpherePolygon.
 
 class HorPlanePolygon : public Polygon
 {
   public:
   HorPlanePolygon( const Polygon & orig, bool clip_neg ) ;
+  virtual VertexArrayView vertexes3D() const ;
+
+  const Polygon & original ;
+  bool            clip_neg ;
+  bool            clipped ;  // true when the clipped vertexes are stored in 'points3D'
 };
 
 // *****************************************************************************
@@ -379,21 +815,31 @@ class YCylinderPoint : public Point
 // *****************************************************************************
 // class YCylinderPolygon
 // a polygon obtained by projecting another polygon onto the Y-axis cylinder
+// (through the sphere). Vertexes are mapped from the original polygon, as in
+// SpherePolygon.
 
 class YCylinderPolygon : public Polygon
 {
   public:
   YCylinderPolygon( const Polygon & orig ) ;
+  virtual VertexArrayView vertexes3D() const ;
+
+  const Polygon & original ;
 };
 
 // *****************************************************************************
 // class ZCylinderPolygon
-// a polygon obtained by projecting another polygon onto the Y-axis cylinder
+// a polygon obtained by projecting another polygon onto the Z-axis cylinder
+// (through the sphere). Vertexes are mapped from the original polygon, as in
+// SpherePolygon.
 
 class ZCylinderPolygon : public Polygon
 {
   public:
   ZCylinderPolygon( const Polygon & orig ) ;
+  virtual VertexArrayView vertexes3D() const ;
+
+  const Polygon & original ;
 };
 
 // *****************************************************************************
@@ -407,6 +853,43 @@ class ZCylinderPolygonWithSector : public Polygon
                                                     real lonX, real lonY ) ;
 };
 
+// *****************************************************************************
+// class SVGDefs
+// Repeated subgraphs of a set of objects: children (at any depth) whose SVG
+// output is identical to that of other children, up to a translation. Each one
+// is written once in the <defs> section, and each occurrence is written as a
+// <use> element (with a 'translate' transform when it is displaced). Objects
+// are compared by a hash of their output relative to their bounding box. Only
+// subgraphs with at least 'min_bytes' bytes of output which are used at least
+// twice are considered, and the outermost repeated subgraphs are preferred.
+
+class SVGDefs
+{
+   public:
+   SVGDefs( ObjectsSet & root, std::size_t min_bytes = default_min_bytes ) ;
+
+   bool empty() const { return defs.empty() ; }
+
+   // write the definitions (to be placed inside the <defs> element)
+   void writeDefs( std::ostream & os ) const ;
+
+   // when 'obj' is a repeated subgraph, write a <use> element for it and return true
+   bool writeUse( const Object * obj, std::ostream & os ) const ;
+
+   static constexpr std::size_t default_min_bytes = 256 ;
+
+   private:
+   class Use
+   {
+      public:
+      std::size_t def_index ;
+      vec2        translation ;
+   } ;
+
+   std::vector<std::string>         defs ; // SVG text of each repeated subgraph
+   std::map<const Object *, Use>    uses ;
+} ;
+
 // *****************************************************************************
 // class Figure
 // A container for a set of objects which can be drawn to a SVG file.
@@ -418,12 +901,62 @@ class Figure
    public:
 
    Figure( ) ;
+   virtual ~Figure() ; // (objects are not owned by the figure)
+
+   // project the objects once and write them to several files in a single
+   // traversal. The format is selected by the file name suffix: '.png' (raster,
+   // 'width_px' pixels wide), '.pdf' or else SVG ('.svgz' for gzip-compressed
+   // SVG). At most one SVG file can be given. When 'manifest_path' is not empty,
+   // files already written from a figure with the same hash are skipped (and
+   // nothing is projected when all of them are skipped).
+   void draw( const std::vector<std::string> & nombres_arch, unsigned width_px = 1024 ) ;
+
+   // add the camera, the output width and all the objects to a hash
+   void hash( SceneHasher & h ) const ;
+
+   // write the figure to a file, gzip-compressed when the name ends in '.svgz'
    void drawSVG( const std::string & nombre_arch ) ;
 
+   // write the figure to a stream
+   void drawSVG( std::ostream & os ) ;
+
+   // rasterize the figure and write it to a PNG file ('width_px' pixels wide)
+   void drawPNG( const std::string & nombre_arch, unsigned width_px ) ;
+
+   // write the figure to a vector PDF file (a single page, 'width_cm' wide)
+   void drawPDF( const std::string & nombre_arch ) ;
+
+   // the contents of an output file in memory, 'format' is "svg", "png" ('width_px'
+   // pixels wide) or "pdf" (throws std::runtime_error for other formats)
+   std::string drawBytes( const std::string & format, unsigned width_px = 1024 ) ;
+
+   // projects the objects (if needed) and computes the region shown in the
+   // output (bounding box of the objects plus a margin)
+   void viewBox( vec2 & box_min, vec2 & box_w ) ;
+
+   // SVG header (including the gradient definitions, and the repeated subgraphs
+   // when 'svg_defs' is not null) and footer
+   void beginSVG( std::ostream & os, const vec2 & box_min, const vec2 & box_w,
+                  const SVGDefs * svg_defs = nullptr ) ;
+   void endSVG( std::ostream & os ) ;
+
+   // write the files (without checking the manifest)
+   void drawFiles( const std::vector<std::string> & nombres_arch, unsigned width_px ) ;
+
    Camera     cam ;      // camera used to project all the points
    ObjectsSet objetos ;  // set of objects in the figure
    real       width_cm ; // width (in centimeters) in the SVG header
    bool       flip_axes ; // true to flip axes (see Axes::Axes), false by default
+   int        svgz_level ; // compression level for '.svgz' files (1 to 9, 6 by default)
+   bool       svg_use_defs ; // write repeated subgraphs once, see SVGDefs (true by default)
+   std::size_t svg_mapped_min_bytes ; // '.svg' files estimated to be at least this size are
+                                      // written through a memory mapping, see MappedOutBuf (64 MB by default)
+
+   CompressionStats svgz_stats ; // counters for the last '.svgz' file written
+   SVGSizeStats *   size_stats ; // when not null, the bytes of SVG outputs are accounted here (null by default)
+
+   std::string manifest_path ;                // manifest of output hashes (see 'draw'), empty by default
+   std::vector< std::string > skipped_files ; // files skipped (up to date) by the last 'draw'
 
    std::vector< std::string > rad_fill_grad_names ; // name of radial fill gradients to output
 } ;
@@ -0,0 +1,60 @@
+// *********************************************************************
+// **
+// ** File: unit_circle.cpp
+// ** Points on the unit circle, for any number of points
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#include "unit_circle.hpp"
+
+// *****************************************************************************
+// class UnitCircle
+// -----------------------------------------------------------------------------
+
+UnitCircle::UnitCircle( unsigned p_n )
+{
+   assert( 0 < p_n );
+   n = p_n ;
+
+   switch( n )
+   {
+      case 64 :
+         cos_values = UnitCircleTable<64>::cos_values ;
+         sin_values = UnitCircleTable<64>::sin_values ;
+         return ;
+      case 128 :
+         cos_values = UnitCircleTable<128>::cos_values ;
+         sin_values = UnitCircleTable<128>::sin_values ;
+         return ;
+      case 256 :
+         cos_values = UnitCircleTable<256>::cos_values ;
+         sin_values = UnitCircleTable<256>::sin_values ;
+         return ;
+      default :
+         break ;
+   }
+
+   // other counts: the same (constexpr) functions, evaluated at run time
+   computed.resize( 2*n );
+   for( unsigned i = 0 ; i < n ; i++ )
+   {
+      computed[i]   = float( unit_cos( i, n ) );
+      computed[n+i] = float( unit_sin( i, n ) );
+   }
+   cos_values = computed.data() ;
+   sin_values = computed.data() + n ;
+}
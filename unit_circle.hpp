@@ -0,0 +1,145 @@
+// *********************************************************************
+// **
+// ** File: unit_circle.hpp
+// ** Tables of points on the unit circle, generated at compile time
+// ** Copyright (C) 2017 Carlos Ureña
+// **
+// ** This program is free software: you can redistribute it and/or modify
+// ** it under the terms of the GNU General Public License as published by
+// ** the Free Software Foundation, either version 3 of the License, or
+// ** (at your option) any later version.
+// **
+// ** This program is distributed in the hope that it will be useful,
+// ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+// ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// ** GNU General Public License for more details.
+// **
+// ** You should have received a copy of the GNU General Public License
+// ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+// **
+//
+
+#ifndef UNIT_CIRCLE_HPP
+#define UNIT_CIRCLE_HPP
+
+#include <cassert>
+#include <vector>
+
+// *****************************************************************************
+// constexpr sine and cosine of the angle 2*pi*i/n (C++11 constexpr functions,
+// so a single return statement each). The angle is reduced to the nearest
+// quadrant with integer arithmetic, x = (pi/(2n))*(4i-k*n) with k = round(4i/n)
+// and |x| <= pi/4, and sin(x), cos(x) are evaluated with Taylor series in
+// double precision (the values at multiples of pi/2 are exact; 0.0 is added to
+// avoid negative zeros).
+
+namespace unit_circle_impl
+{
+   constexpr double pi = 3.14159265358979323846 ;
+
+   // sum of the terms of a Taylor series from 'term' on, each one is the previous
+   // times -x^2/((k+1)(k+2)), stops when the terms are negligible
+   constexpr double series( double x2, double term, unsigned k )
+   {
+      return ( k > 40 || ( term < 1e-40 && -1e-40 < term ) )
+             ? 0.0
+             : term + series( x2, -term*x2/double((k+1)*(k+2)), k+2 ) ;
+   }
+   constexpr double sin_reduced( double x ) { return series( x*x, x, 1 ); }
+   constexpr double cos_reduced( double x ) { return series( x*x, 1.0, 0 ); }
+
+   constexpr unsigned quadrant( unsigned i, unsigned n ) { return (4*i + n/2)/n ; }
+
+   constexpr double reduced( unsigned i, unsigned n )
+   {
+      return (pi/(2.0*double(n)))*( double(4*i) - double(quadrant(i,n)*n) ) ;
+   }
+
+   constexpr double cos_q( double x, unsigned q )
+   {
+      return q == 0 ? cos_reduced(x) : q == 1 ? -sin_reduced(x) : q == 2 ? -cos_reduced(x) : sin_reduced(x) ;
+   }
+   constexpr double sin_q( double x, unsigned q )
+   {
+      return q == 0 ? sin_reduced(x) : q == 1 ? cos_reduced(x) : q == 2 ? -sin_reduced(x) : -cos_reduced(x) ;
+   }
+}
+
+constexpr double unit_cos( unsigned i, unsigned n )
+{
+   return 0.0 + unit_circle_impl::cos_q( unit_circle_impl::reduced( i, n ), unit_circle_impl::quadrant( i, n ) % 4 ) ;
+}
+constexpr double unit_sin( unsigned i, unsigned n )
+{
+   return 0.0 + unit_circle_impl::sin_q( unit_circle_impl::reduced( i, n ), unit_circle_impl::quadrant( i, n ) % 4 ) ;
+}
+
+// *****************************************************************************
+// a pack with the indexes 0,1,...,n-1 (std::index_sequence is C++14)
+
+template< unsigned... I > class IndexPack { } ;
+
+template< unsigned n, unsigned... I >
+class MakeIndexPack
+{
+   public:
+   typedef typename MakeIndexPack< n-1, n-1, I... >::type type ;
+} ;
+
+template< unsigned... I >
+class MakeIndexPack< 0, I... >
+{
+   public:
+   typedef IndexPack< I... > type ;
+} ;
+
+// *****************************************************************************
+// class UnitCircleTable<n>
+// cosines and sines of the angles 2*pi*i/n (i = 0..n-1), computed at compile
+// time and rounded to float
+
+template< unsigned n, class Indexes = typename MakeIndexPack<n>::type >
+class UnitCircleTable ;
+
+template< unsigned n, unsigned... I >
+class UnitCircleTable< n, IndexPack< I... > >
+{
+   public:
+   static constexpr float cos_values[n] = { float( unit_cos( I, n ) )... } ;
+   static constexpr float sin_values[n] = { float( unit_sin( I, n ) )... } ;
+} ;
+
+template< unsigned n, unsigned... I >
+constexpr float UnitCircleTable< n, IndexPack< I... > >::cos_values[n] ;
+
+template< unsigned n, unsigned... I >
+constexpr float UnitCircleTable< n, IndexPack< I... > >::sin_values[n] ;
+
+// *****************************************************************************
+// class UnitCircle
+// the points of the unit circle at angles 2*pi*i/n: for the counts used by the
+// figures (see 'tabulated'), the compile-time tables are used, without any
+// trigonometric call; for other counts, the values are computed (once, in the
+// constructor) with the same rounding.
+
+class UnitCircle
+{
+   public:
+   UnitCircle( unsigned p_n ) ;
+   UnitCircle( const UnitCircle & ) = delete ;            // (may point to 'computed')
+   UnitCircle & operator = ( const UnitCircle & ) = delete ;
+
+   static bool tabulated( unsigned n ) { return n == 64 || n == 128 || n == 256 ; }
+
+   unsigned size() const { return n ; }
+   float cos( unsigned i ) const { assert( i < n ); return cos_values[i] ; }
+   float sin( unsigned i ) const { assert( i < n ); return sin_values[i] ; }
+
+   private:
+   unsigned           n ;
+   const float *      cos_values ;
+   const float *      sin_values ;
+   std::vector<float> computed ;   // values for counts not tabulated (cosines, then sines)
+} ;
+
+#endif